@@ -1,11 +1,18 @@
 ﻿#include <iostream>
 #include <unordered_map>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+// keep windows.h from defining min/max macros that break std::min/std::max
+#define NOMINMAX
 #include <winsock2.h>
 #include <Windows.h>
-#include <conio.h>
 #include "sock.h"
 #include "neural.h"
+#include "packed_position.h"
 
 
 // define bitboard data type
@@ -146,6 +153,32 @@ int castle;
 //position key
 U64 hash_key;
 
+//pawn structure key (piece_keys of the pawns only), indexes the pawn hash table
+U64 pawn_key;
+
+//material key (piece counts only, see material_keys), indexes the material table
+U64 material_key;
+
+//material + piece square score [piece][square] from white's point of view, packed mid/end game (filled by init_evaluation)
+int piece_square_score[12][64];
+
+//material + piece square score of the position from white's point of view, updated by make_move
+int psqt_score;
+
+//fifty move rule counter (half moves since the last capture or pawn move)
+int fifty;
+
+// maximum search depth in plies
+#define max_ply 64
+
+// half move counter (distance from the search root)
+int ply;
+
+// keys of the positions of the game and of the line being searched, the current one on top
+#define max_history 2048
+U64 repetition_table[max_history];
+int repetition_index;
+
 /**********************************\
  ==================================
 
@@ -154,8 +187,6 @@ U64 hash_key;
 
  ==================================
 \**********************************/
-// exit from engine flag
-int quit = 0;
 // UCI "movestogo" command moves counter
 int movestogo = 30;
 // UCI "movetime" command time counter
@@ -164,97 +195,76 @@ int movetime = -1;
 int _time = -1;
 // UCI "inc" command's time increment holder
 int inc = 0;
+// UCI "nodes" command node limit (0 = no limit)
+long long nodes_limit = 0;
+// UCI "mate" command: stop once a mate in this many moves is found (0 = off)
+int mate_limit = 0;
 // UCI "starttime" command time holder
-int starttime = 0;
-// UCI "stoptime" command time holder
-int stoptime = 0;
-// variable to flag time control availability
-int timeset = 0;
-// variable to flag when the time is up
-int stopped = 0;
-
+long long starttime = 0;
+// hard limit: the search is aborted (even mid-iteration) past this point
+long long stoptime = 0;
+// optimum time for this move, scaled between iterations by search stability
+long long optimum_time = 0;
+// maximum time for this move (stoptime - starttime)
+long long maximum_time = 0;
+// "Move Overhead" UCI option: ms reserved per move for GUI/network latency
+int move_overhead = 50;
+// variable to flag time control availability (set late by "ponderhit")
+std::atomic<int> timeset{ 0 };
+// variable to flag when the time is up (set by the UCI thread on "stop")
+std::atomic<int> stopped{ 0 };
+// searching on the opponent's time: no time limits and no bestmove until "ponderhit"/"stop"
+std::atomic<int> pondering{ 0 };
+
+// nodes visited by perft / searched by negamax and quiescence
+long long nodes;
+
+// monotonic clock with millisecond resolution (GetTickCount() only ticks every ~15ms)
 long long get_time_ms() {
-    return GetTickCount();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-int input_waiting()
-{
-    static int init = 0, pipe;
-    static HANDLE inh;
-    DWORD dw;
-
-    if (!init)
-    {
-        init = 1;
-        inh = GetStdHandle(STD_INPUT_HANDLE);
-        pipe = ~GetConsoleMode(inh, &dw);
-        if (!pipe)
-        {
-            SetConsoleMode(inh, dw & ~(ENABLE_MOUSE_INPUT | ENABLE_WINDOW_INPUT));
-            FlushConsoleInputBuffer(inh);
-        }
-    }
-
-    if (pipe)
-    {
-        if (!PeekNamedPipe(inh, NULL, 0, NULL, &dw, NULL)) return 1;
-        return dw;
-    }
+/*
+    Time manager
 
-    else
-    {
-        GetNumberOfConsoleInputEvents(inh, &dw);
-        return dw <= 1 ? 0 : dw;
+    The remaining clock is split into two budgets:
+      - optimum: the time we'd like to spend; only checked between iterations
+                 and scaled up/down by how stable the search looks
+      - maximum: the hard deadline, checked every 2048 nodes by communicate()
+*/
+void init_time_manager() {
+    // fixed time per move: both budgets are the same
+    if (movetime != -1) {
+        optimum_time = maximum_time = std::max(1, movetime - move_overhead);
+        return;
     }
-}
-
-void read_input()
-{
-    // bytes to read holder
-    int bytes=0;
 
-    // GUI/user input
-    char input[256] = "", * endc;
+    // moves we have to play with the clock we've got (sudden death -> assume 30)
+    int mtg = (movestogo > 0) ? std::min(movestogo, 50) : 30;
 
-    // "listen" to STDIN
-    if (input_waiting())
-    {
-        // tell engine to stop calculating
-        stopped = true;
+    // usable clock including the increments we'll receive, minus the latency of each move
+    long long usable = (long long)_time + (long long)inc * (mtg - 1) - (long long)move_overhead * mtg;
+    usable = std::max(usable, 1LL);
 
-        // loop to read bytes from STDIN
-        do
-        {
-            // Windows-specific way to read single byte from stdin
-            if (_kbhit()) {  // Verifica se c'è un byte pronto per la lettura
-                input[bytes] = _getch();  // Legge un carattere da stdin
-                bytes++;  // Incrementa il contatore dei byte letti
-            }
-        } while (bytes < 256 && _kbhit());  // Continua a leggere finché ci sono byte disponibili
+    optimum_time = usable / mtg;
 
-        // searches for the first occurrence of '\n'
-        endc = strchr(input, '\n');
+    // in trouble we may spend up to 5x the optimum, but never flag on this move
+    maximum_time = std::min(optimum_time * 5, (long long)(_time - move_overhead) * 8 / 10);
+    maximum_time = std::max(maximum_time, 1LL);
+    optimum_time = std::min(optimum_time, maximum_time);
+}
 
-        // if found new line set value at pointer to 0
-        if (endc) *endc = 0;
+// scale the optimum budget: stable best move -> stop early, flips or score drops -> extend
+long long scaled_optimum_time(int best_move_stability, int score_drop) {
+    // 1.40 right after the best move changed, down to 0.80 after 6 stable iterations
+    int scale = 140 - 10 * std::min(best_move_stability, 6);
 
-        // if input is available
-        if (strlen(input) > 0)
-        {
-            // match UCI "quit" command
-            if (strncmp(input, "quit", 4) == 0)
-            {
-                // tell engine to terminate execution    
-                quit = true;
-            }
+    // score got worse since the previous iteration: up to +50%
+    if (score_drop > 0)
+        scale = scale * (100 + std::min(score_drop, 100) / 2) / 100;
 
-            // match UCI "stop" command
-            else if (strncmp(input, "stop", 4) == 0) {
-                // tell engine to terminate execution
-                quit = true;
-            }
-        }
-    }
+    return std::min(optimum_time * scale / 100, maximum_time);
 }
 
 // a bridge function to interact between search and GUI input
@@ -265,8 +275,12 @@ static void communicate() {
         stopped = 1;
     }
 
-    // read GUI input
-    read_input();
+    // UCI "go nodes" limit reached
+    if (nodes_limit && nodes >= nodes_limit)
+        stopped = 1;
+
+    // GUI input (stop, ponderhit, quit) is handled by the UCI loop while the
+    // search runs on its own thread, see stop_search() / ponderhit()
 }
 
 /**********************************\
@@ -328,6 +342,22 @@ U64 get_random_U64_number() {
     return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
 }
 
+// 64-bit xorshift for the zobrist keys: keys pieced together from the 32-bit
+// generator are all linear in its 32-bit state, so different sets of them
+// xor to the same key far too often
+U64 key_random_state = 0x9E3779B97F4A7C15ULL;
+
+U64 get_random_key() {
+    U64 number = key_random_state;
+
+    number ^= number << 13;
+    number ^= number >> 7;
+    number ^= number << 17;
+    key_random_state = number;
+
+    return number;
+}
+
 // generate magic number candidate
 U64 generate_magic_number() {
     return get_random_U64_number() & get_random_U64_number() & get_random_U64_number();
@@ -348,22 +378,29 @@ U64 enpassant_keys[64];
 U64 castle_keys[16];
 // random side key
 U64 side_key;
+// random material keys [piece][count]: a position with n pieces of a kind hashes entries 0..n-1
+U64 material_keys[12][16];
 
 // init random hash keys
 void init_random_keys(){
-    random_state = 1804289383;
+    key_random_state = 0x9E3779B97F4A7C15ULL;
     for (int piece = P; piece <= k; piece++){
         for (int square = 0; square < 64; square++)
-            piece_keys[piece][square] = get_random_U64_number();
+            piece_keys[piece][square] = get_random_key();
     }
 
     for (int square = 0; square < 64; square++)
-        enpassant_keys[square] = get_random_U64_number();
+        enpassant_keys[square] = get_random_key();
 
     for (int index = 0; index < 16; index++)
-        castle_keys[index] = get_random_U64_number();
+        castle_keys[index] = get_random_key();
 
-    side_key = get_random_U64_number();
+    side_key = get_random_key();
+
+    for (int piece = P; piece <= k; piece++){
+        for (int count = 0; count < 16; count++)
+            material_keys[piece][count] = get_random_key();
+    }
 }
 
 // generate position key from scratch (can be collisions)
@@ -398,6 +435,55 @@ U64 generate_hash_key(){
     return final_key;
 }
 
+// generate pawn structure key from scratch
+U64 generate_pawn_key(){
+    U64 final_key = 0ULL;
+
+    for (int piece = P; piece <= p; piece += p - P){
+        U64 bitboard = bitboards[piece];
+        while (bitboard){
+            int square = get_ls1b_index(bitboard);
+
+            final_key ^= piece_keys[piece][square];
+
+            popSquare(bitboard, square);
+        }
+    }
+
+    return final_key;
+}
+
+// generate material key from scratch
+U64 generate_material_key(){
+    U64 final_key = 0ULL;
+
+    for (int piece = P; piece <= k; piece++){
+        for (int count = 0; count < (int)count_bits(bitboards[piece]); count++)
+            final_key ^= material_keys[piece][count];
+    }
+
+    return final_key;
+}
+
+// generate material + piece square score from scratch
+int generate_psqt_score(){
+    int score = 0;
+    U64 bitboard;
+
+    for (int piece = P; piece <= k; piece++){
+        bitboard = bitboards[piece];
+        while (bitboard){
+            int square = get_ls1b_index(bitboard);
+
+            score += piece_square_score[piece][square];
+
+            popSquare(bitboard, square);
+        }
+    }
+
+    return score;
+}
+
 
 /**********************************\
  ==================================
@@ -461,7 +547,10 @@ void print_board() {
         << ((castle & wq) ? 'Q' : '-')
         << ((castle & bk) ? 'k' : '-')
         << ((castle & bq) ? 'q' : '-')
-        << "\n\n";
+        << "\n";
+
+    // Print half move clock
+    std::cout << "     Fifty:     " << fifty << "\n\n";
 
     std::cout << "     Hash Key: " << std::hex << hash_key << std::dec;
 }
@@ -477,6 +566,7 @@ void parse_fen(char* fen){
     side = 0;
     enpassant = no_sq;
     castle = 0;
+    fifty = 0;
 
     // loop over board ranks
     for (int rank = 0; rank < 8; rank++){
@@ -544,6 +634,13 @@ void parse_fen(char* fen){
 
     } else enpassant = no_sq;
 
+    //go to parsing the half move clock (the full move number isn't used)
+    while (*fen && *fen != ' ') fen++;
+    while (*fen == ' ') fen++;
+
+    //parse half move clock
+    if (*fen >= '0' && *fen <= '9') fifty = atoi(fen);
+
     //loop over white pieces bitboards
     for (int piece = P; piece <= K; piece++)  occupancies[white] |= bitboards[piece];
 
@@ -556,6 +653,15 @@ void parse_fen(char* fen){
 
     //init hash key of the pos
     hash_key = generate_hash_key();
+    pawn_key = generate_pawn_key();
+    material_key = generate_material_key();
+
+    //init material + piece square score
+    psqt_score = generate_psqt_score();
+
+    //the game history starts here
+    repetition_index = 0;
+    repetition_table[0] = hash_key;
 }
 
 /**********************************\
@@ -1142,8 +1248,11 @@ static inline void add_move(moves* move_list, int move) {
 //debug
 void print_move(int move) {
     std::cout << square_to_coordinates[get_move_source(move)]
-        << square_to_coordinates[get_move_target(move)]
-        << promoted_pieces[get_move_promoted(move)];
+        << square_to_coordinates[get_move_target(move)];
+
+    // promotion suffix only (a missing key would print a NUL byte to the GUI)
+    if (get_move_promoted(move))
+        std::cout << promoted_pieces[get_move_promoted(move)];
 }
 void print_move_list(moves* move_list) {
     std::cout << "\n    move    piece   capture   double    enpass    castling\n\n";
@@ -1179,13 +1288,19 @@ void print_move_list(moves* move_list) {
     memcpy(bitboards_copy, bitboards, 96);                                \
     memcpy(occupancies_copy, occupancies, 24);                            \
     side_copy = side, enpassant_copy = enpassant, castle_copy = castle;   \
-    U64 hash_key_copy = hash_key;                                         \
+    U64 hash_key_copy = hash_key, pawn_key_copy = pawn_key;               \
+    U64 material_key_copy = material_key;                                 \
+    int psqt_score_copy = psqt_score;                                     \
+    int fifty_copy = fifty, repetition_index_copy = repetition_index;     \
 //restore board state
 #define take_back()                                                       \
     memcpy(bitboards, bitboards_copy, 96);                                \
     memcpy(occupancies, occupancies_copy, 24);                            \
     side = side_copy, enpassant = enpassant_copy, castle = castle_copy;   \
-    hash_key = hash_key_copy;                                             \
+    hash_key = hash_key_copy, pawn_key = pawn_key_copy;                   \
+    material_key = material_key_copy;                                     \
+    psqt_score = psqt_score_copy;                                         \
+    fifty = fifty_copy, repetition_index = repetition_index_copy;         \
 
 //attacked squares
 static inline int is_square_attacked(int square, int side) {
@@ -1198,14 +1313,11 @@ static inline int is_square_attacked(int square, int side) {
     //attacked by knights
     if (knight_attacks[square] & ((side == white) ? bitboards[N] : bitboards[n])) return 1;
 
-    //attacked by bishops
-    if (get_bishop_attacks(square, occupancies[both]) & ((side == white) ? bitboards[B] : bitboards[b])) return 1;
+    //attacked by bishops or queens on diagonals
+    if (get_bishop_attacks(square, occupancies[both]) & ((side == white) ? (bitboards[B] | bitboards[Q]) : (bitboards[b] | bitboards[q]))) return 1;
 
-    //attacked by rooks
-    if (get_rook_attacks(square, occupancies[both]) & ((side == white) ? bitboards[R] : bitboards[r])) return 1;
-
-    //attacked by bishops
-    if (get_queen_attacks(square, occupancies[both]) & ((side == white) ? bitboards[Q] : bitboards[q])) return 1;
+    //attacked by rooks or queens on lines
+    if (get_rook_attacks(square, occupancies[both]) & ((side == white) ? (bitboards[R] | bitboards[Q]) : (bitboards[r] | bitboards[q]))) return 1;
 
     //attacked by kings
     if (king_attacks[square] & ((side == white) ? bitboards[K] : bitboards[k])) return 1;
@@ -1282,6 +1394,12 @@ static inline int make_move(int move, int move_flag){
         hash_key ^= piece_keys[piece][source_square]; // remove piece from source square in hash key
         hash_key ^= piece_keys[piece][target_square]; // set piece to the target square in hash key
 
+        // score piece
+        psqt_score += piece_square_score[piece][target_square] - piece_square_score[piece][source_square];
+
+        // hash pawn structure
+        if (piece == P || piece == p) pawn_key ^= piece_keys[piece][source_square] ^ piece_keys[piece][target_square];
+
 
         //handle capture
         if (capture){
@@ -1309,6 +1427,11 @@ static inline int make_move(int move, int move_flag){
 
                     // remove the piece from hash key
                     hash_key ^= piece_keys[bb_piece][target_square];
+
+                    // remove the piece from the score
+                    psqt_score -= piece_square_score[bb_piece][target_square];
+                    if (bb_piece == P || bb_piece == p) pawn_key ^= piece_keys[bb_piece][target_square];
+                    material_key ^= material_keys[bb_piece][count_bits(bitboards[bb_piece])];
                     break;
                 }
             }
@@ -1324,6 +1447,9 @@ static inline int make_move(int move, int move_flag){
 
                 // remove pawn from hash key
                 hash_key ^= piece_keys[P][target_square];
+                psqt_score -= piece_square_score[P][target_square];
+                pawn_key ^= piece_keys[P][target_square];
+                material_key ^= material_keys[P][count_bits(bitboards[P])];
             }
 
             // black to move
@@ -1334,6 +1460,9 @@ static inline int make_move(int move, int move_flag){
 
                 // remove pawn from hash key
                 hash_key ^= piece_keys[p][target_square];
+                psqt_score -= piece_square_score[p][target_square];
+                pawn_key ^= piece_keys[p][target_square];
+                material_key ^= material_keys[p][count_bits(bitboards[p])];
             }
 
             // set up promoted piece on chess board
@@ -1341,6 +1470,8 @@ static inline int make_move(int move, int move_flag){
 
             // add promoted piece into the hash key
             hash_key ^= piece_keys[promoted_piece][target_square];
+            psqt_score += piece_square_score[promoted_piece][target_square];
+            material_key ^= material_keys[promoted_piece][count_bits(bitboards[promoted_piece]) - 1];
         }
 
         //handle enpassant
@@ -1354,6 +1485,9 @@ static inline int make_move(int move, int move_flag){
 
                 // remove pawn from hash key
                 hash_key ^= piece_keys[p][target_square + 8];
+                psqt_score -= piece_square_score[p][target_square + 8];
+                pawn_key ^= piece_keys[p][target_square + 8];
+                material_key ^= material_keys[p][count_bits(bitboards[p])];
             }
 
             // black to move
@@ -1363,6 +1497,9 @@ static inline int make_move(int move, int move_flag){
 
                 // remove pawn from hash key
                 hash_key ^= piece_keys[P][target_square - 8];
+                psqt_score -= piece_square_score[P][target_square - 8];
+                pawn_key ^= piece_keys[P][target_square - 8];
+                material_key ^= material_keys[P][count_bits(bitboards[P])];
             }
         }
         
@@ -1404,6 +1541,7 @@ static inline int make_move(int move, int move_flag){
                     // hash rook
                     hash_key ^= piece_keys[R][h1];  // remove rook from h1 from hash key
                     hash_key ^= piece_keys[R][f1];  // put rook on f1 into a hash key
+                    psqt_score += piece_square_score[R][f1] - piece_square_score[R][h1];
                     break;
 
                     // white castles queen side
@@ -1413,6 +1551,7 @@ static inline int make_move(int move, int move_flag){
 
                     hash_key ^= piece_keys[R][a1];  // remove rook from a1 from hash key
                     hash_key ^= piece_keys[R][d1];  // put rook on d1 into a hash key
+                    psqt_score += piece_square_score[R][d1] - piece_square_score[R][a1];
                     break;
 
                     // black castles king side
@@ -1423,6 +1562,7 @@ static inline int make_move(int move, int move_flag){
                     // hash rook
                     hash_key ^= piece_keys[r][h8];  // remove rook from h8 from hash key
                     hash_key ^= piece_keys[r][f8];  // put rook on f8 into a hash key
+                    psqt_score += piece_square_score[r][f8] - piece_square_score[r][h8];
                     break;
 
                     // black castles queen side
@@ -1433,6 +1573,7 @@ static inline int make_move(int move, int move_flag){
                     // hash rook
                     hash_key ^= piece_keys[r][a8];  // remove rook from a8 from hash key
                     hash_key ^= piece_keys[r][d8];  // put rook on d8 into a hash key
+                    psqt_score += piece_square_score[r][d8] - piece_square_score[r][a8];
                     break;
             }
         }
@@ -1471,6 +1612,13 @@ static inline int make_move(int move, int move_flag){
             return 0;
         }
 
+        // captures and pawn moves can't be repeated, they reset the fifty move counter
+        if (capture || piece == P || piece == p) fifty = 0;
+        else fifty++;
+
+        // push the new position to the history
+        if (repetition_index < max_history - 1) repetition_table[++repetition_index] = hash_key;
+
         return 1;
     }
     
@@ -1478,7 +1626,7 @@ static inline int make_move(int move, int move_flag){
     //capture moves
     else{
         // make sure move is the capture
-        if (get_move_capture(move)) make_move(move, all_moves);
+        if (get_move_capture(move)) return make_move(move, all_moves);
 
         // otherwise the move is not a capture
         else
@@ -2041,7 +2189,6 @@ static inline void print_generate_moves() {
  ==================================
 \**********************************/
 
-long nodes;
 static inline void perft_driver(int depth) {
     if (depth == 0){
         nodes++;
@@ -2103,6 +2250,253 @@ void perft_test(int depth){
     std::cout << "\n    Time: " << get_time_ms() - start << "ms";
 }
 
+/**********************************\
+ ==================================
+
+        Repetition detection
+
+ ==================================
+\**********************************/
+
+// squares strictly between two squares on the same line [square][square]
+U64 between_squares[64][64];
+
+// keys and moves of every reversible piece move, looked up by the key difference it makes
+#define cuckoo_size 8192
+#define cuckoo_h1(key) ((int)((key) & (cuckoo_size - 1)))
+#define cuckoo_h2(key) ((int)(((key) >> 16) & (cuckoo_size - 1)))
+
+U64 cuckoo_keys[cuckoo_size];
+int cuckoo_moves[cuckoo_size];
+
+// init between squares and the cuckoo tables (after the attack tables and the hash keys)
+void init_cuckoo(){
+    memset(between_squares, 0ULL, sizeof(between_squares));
+    memset(cuckoo_keys, 0ULL, sizeof(cuckoo_keys));
+    memset(cuckoo_moves, 0, sizeof(cuckoo_moves));
+
+    for (int source_square = 0; source_square < 64; source_square++){
+        for (int target_square = 0; target_square < 64; target_square++){
+            if (get_bishop_attacks(source_square, 0ULL) & (1ULL << target_square))
+                between_squares[source_square][target_square] =
+                    get_bishop_attacks(source_square, 1ULL << target_square) & get_bishop_attacks(target_square, 1ULL << source_square);
+
+            if (get_rook_attacks(source_square, 0ULL) & (1ULL << target_square))
+                between_squares[source_square][target_square] =
+                    get_rook_attacks(source_square, 1ULL << target_square) & get_rook_attacks(target_square, 1ULL << source_square);
+        }
+    }
+
+    for (int piece = P; piece <= k; piece++){
+        // pawn moves are irreversible
+        if (piece == P || piece == p) continue;
+
+        for (int source_square = 0; source_square < 64; source_square++){
+            for (int target_square = source_square + 1; target_square < 64; target_square++){
+                U64 attacks;
+
+                switch (piece % 6){
+                    case N: attacks = knight_attacks[source_square]; break;
+                    case B: attacks = get_bishop_attacks(source_square, 0ULL); break;
+                    case R: attacks = get_rook_attacks(source_square, 0ULL); break;
+                    case Q: attacks = get_queen_attacks(source_square, 0ULL); break;
+                    default: attacks = king_attacks[source_square]; break;
+                }
+
+                if (!getSquare(attacks, target_square)) continue;
+
+                int move = encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0);
+                U64 key = piece_keys[piece][source_square] ^ piece_keys[piece][target_square] ^ side_key;
+
+                // cuckoo insertion: kick the old entry to its other slot until one is free
+                int index = cuckoo_h1(key);
+                while (1){
+                    std::swap(cuckoo_keys[index], key);
+                    std::swap(cuckoo_moves[index], move);
+
+                    if (move == 0) break;
+
+                    index = (index == cuckoo_h1(key)) ? cuckoo_h2(key) : cuckoo_h1(key);
+                }
+            }
+        }
+    }
+}
+
+// the current position already occurred since the last irreversible move
+static inline int is_repetition(){
+    for (int index = repetition_index - 2; index >= 0 && index >= repetition_index - fifty; index -= 2)
+        if (repetition_table[index] == hash_key) return 1;
+
+    return 0;
+}
+
+/*
+    Can the side to move repeat a position of the line with one move?
+
+    The key of a position i plies back differs from the current one by
+    one reversible move exactly when the difference is in the cuckoo
+    table; the move is playable if nothing stands in between. Only
+    cycles inside the search tree (i < ply) count.
+*/
+static inline int has_upcoming_repetition(){
+    for (int distance = 3; distance <= fifty && distance <= repetition_index; distance += 2){
+        U64 move_key = hash_key ^ repetition_table[repetition_index - distance];
+
+        int index = cuckoo_h1(move_key);
+        if (cuckoo_keys[index] != move_key){
+            index = cuckoo_h2(move_key);
+            if (cuckoo_keys[index] != move_key) continue;
+        }
+
+        int move = cuckoo_moves[index];
+        if (between_squares[get_move_source(move)][get_move_target(move)] & occupancies[both]) continue;
+
+        if (ply > distance) return 1;
+    }
+
+    return 0;
+}
+
+/**********************************\
+ ==================================
+
+            Attack info
+
+ ==================================
+\**********************************/
+
+// all pieces of both sides attacking a square for a given occupancy
+static inline U64 attackers_to(int square, U64 occupancy){
+    return (pawn_attacks[black][square] & bitboards[P]) |
+           (pawn_attacks[white][square] & bitboards[p]) |
+           (knight_attacks[square] & (bitboards[N] | bitboards[n])) |
+           (king_attacks[square] & (bitboards[K] | bitboards[k])) |
+           (get_bishop_attacks(square, occupancy) & (bitboards[B] | bitboards[b] | bitboards[Q] | bitboards[q])) |
+           (get_rook_attacks(square, occupancy) & (bitboards[R] | bitboards[r] | bitboards[Q] | bitboards[q]));
+}
+
+/*
+      ================================
+          Per ply attack info
+      --------------------------------
+      Computed the first time a node asks for it and reused by
+      everything else at that node (check detection, SEE pins,
+      evaluation). An entry is valid while its key matches the
+      position, so nothing has to invalidate it on make/take back.
+      ================================
+*/
+typedef struct {
+    U64 hash_key;          // position the entry was computed for
+    U64 attacks[12];       // squares attacked by every piece bitboard [piece]
+    int mobility[12];      // attacked squares not taken by own pieces nor covered by enemy pawns, summed per piece [piece]
+    int king_zone_attacks[12]; // attacks on the enemy king and the squares around it, summed per piece [piece]
+    U64 attacked_by[2];    // squares attacked by a side [side]
+    U64 checkers;          // enemy pieces giving check to the side to move
+    U64 pinned[2];         // pieces pinned to their own king [side]
+    U64 pinners[2];        // sliders pinning an enemy piece [side]
+} attack_info;
+
+attack_info attack_infos[max_ply + 1];
+
+// pieces of a side pinned to its king, and the enemy sliders pinning them
+static inline void find_pins(attack_info* info, int color){
+    int king_square = get_ls1b_index(bitboards[(color == white) ? K : k]);
+    int enemy = color ^ 1;
+
+    // enemy sliders that would see the king on an empty board
+    U64 snipers = (get_bishop_attacks(king_square, 0ULL) & (bitboards[(enemy == white) ? B : b] | bitboards[(enemy == white) ? Q : q])) |
+                  (get_rook_attacks(king_square, 0ULL) & (bitboards[(enemy == white) ? R : r] | bitboards[(enemy == white) ? Q : q]));
+
+    while (snipers){
+        int sniper_square = get_ls1b_index(snipers);
+        U64 blockers = between_squares[king_square][sniper_square] & occupancies[both];
+
+        // exactly one piece in between, and it's ours
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & occupancies[color])){
+            info->pinned[color] |= blockers;
+            setSquare(info->pinners[enemy], sniper_square);
+        }
+
+        popSquare(snipers, sniper_square);
+    }
+}
+
+// attack info of the current position at the current ply
+static inline attack_info* get_attack_info(){
+    attack_info* info = &attack_infos[std::min(ply, max_ply)];
+
+    if (info->hash_key == hash_key) return info;
+
+    info->hash_key = hash_key;
+    info->attacked_by[white] = info->attacked_by[black] = 0ULL;
+
+    // pawns all at once, one shift per capture direction [side][direction]
+    U64 pawn_captures[2][2] = {
+        { (bitboards[P] >> 7) & not_a_file, (bitboards[P] >> 9) & not_h_file },
+        { (bitboards[p] << 9) & not_a_file, (bitboards[p] << 7) & not_h_file }
+    };
+
+    // for the per piece counts the evaluation uses
+    U64 mobility_area[2], king_zone[2];
+    for (int color = white; color <= black; color++){
+        int king_square = get_ls1b_index(bitboards[(color == white) ? K : k]);
+        mobility_area[color] = ~occupancies[color] & ~(pawn_captures[color ^ 1][0] | pawn_captures[color ^ 1][1]);
+        king_zone[color] = king_attacks[king_square] | (1ULL << king_square);
+    }
+
+    for (int piece = P; piece <= k; piece++){
+        int color = (piece <= K) ? white : black;
+        U64 bitboard = bitboards[piece];
+        U64 attacks = 0ULL;
+
+        info->mobility[piece] = info->king_zone_attacks[piece] = 0;
+
+        switch (piece){
+            // each direction's captures are made by different pawns
+            case P: case p:
+                attacks = pawn_captures[color][0] | pawn_captures[color][1];
+                info->king_zone_attacks[piece] = (int)(count_bits(pawn_captures[color][0] & king_zone[color ^ 1]) +
+                                                       count_bits(pawn_captures[color][1] & king_zone[color ^ 1]));
+                break;
+
+            default:
+                while (bitboard){
+                    int square = get_ls1b_index(bitboard);
+                    U64 square_attacks = 0ULL;
+
+                    switch (piece % 6){
+                        case N: square_attacks = knight_attacks[square]; break;
+                        case B: square_attacks = get_bishop_attacks(square, occupancies[both]); break;
+                        case R: square_attacks = get_rook_attacks(square, occupancies[both]); break;
+                        case Q: square_attacks = get_queen_attacks(square, occupancies[both]); break;
+                        case K: square_attacks = king_attacks[square]; break;
+                    }
+
+                    // counted piece by piece: two pieces covering a square both get it
+                    attacks |= square_attacks;
+                    info->mobility[piece] += (int)count_bits(square_attacks & mobility_area[color]);
+                    info->king_zone_attacks[piece] += (int)count_bits(square_attacks & king_zone[color ^ 1]);
+
+                    popSquare(bitboard, square);
+                }
+        }
+
+        info->attacks[piece] = attacks;
+        info->attacked_by[(piece <= K) ? white : black] |= attacks;
+    }
+
+    int king_square = get_ls1b_index(bitboards[(side == white) ? K : k]);
+    info->checkers = attackers_to(king_square, occupancies[both]) & occupancies[side ^ 1];
+
+    info->pinned[white] = info->pinned[black] = 0ULL;
+    info->pinners[white] = info->pinners[black] = 0ULL;
+    find_pins(info, white);
+    find_pins(info, black);
+
+    return info;
+}
+
 /**********************************\
  ==================================
 
@@ -2184,7 +2578,7 @@ const int rook_score[64] ={
 
 };
 
-// king positional score
+// king positional score (end game: walk to the center)
 const int king_score[64] ={
      0,   0,   0,   0,   0,   0,   0,   0,
      0,   0,   5,   5,   5,   5,   0,   0,
@@ -2196,6 +2590,30 @@ const int king_score[64] ={
      0,   0,   5,   0, -15,   0,  10,   0
 };
 
+// king positional score in the middle game: stay castled behind the pawns
+const int king_middlegame_score[64] ={
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -20, -30, -30, -40, -40, -30, -30, -20,
+   -10, -20, -20, -20, -20, -20, -20, -10,
+    20,  20,   0, -10, -10,   0,  20,  20,
+    20,  30,  10,   0,   0,  10,  30,  20
+};
+
+// pawn positional score in the end game: push
+const int pawn_endgame_score[64] ={
+     0,   0,   0,   0,   0,   0,   0,   0,
+    80,  80,  80,  80,  80,  80,  80,  80,
+    50,  50,  50,  50,  50,  50,  50,  50,
+    30,  30,  30,  30,  30,  30,  30,  30,
+    15,  15,  15,  15,  15,  15,  15,  15,
+     5,   5,   5,   5,   5,   5,   5,   5,
+     0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0
+};
+
 // mirror positional score tables for opposite side
 const int mirror_score[128] ={
     a1, b1, c1, d1, e1, f1, g1, h1,
@@ -2208,566 +2626,3983 @@ const int mirror_score[128] ={
     a8, b8, c8, d8, e8, f8, g8, h8
 };
 
-//position evaluation returns score based on white perspective
-static inline int evaluate(){
-    // If neural evaluation is enabled and initialized, use it
-    if (nn_is_enabled()) {
-        // nn_value_cp() is defined from side-to-move perspective already
-        return nn_value_cp();
-    }
-    // static evaluation score
+/*
+      ================================
+           Tapered evaluation
+      --------------------------------
+      Every term has a middle game and an end game value, packed in
+      one int (end game in the high 16 bits) so they are added up
+      together, make_move included. evaluate() blends the two by the
+      game phase: 24 with all minor and major pieces on the board
+      (knight/bishop 1, rook 2, queen 4), 0 with none.
+      ================================
+*/
+#define make_score(mg, eg) ((int)((unsigned int)(eg) << 16) + (mg))
+
+static inline int mg_score(int score){
+    return (short)(unsigned short)(unsigned int)score;
+}
+
+static inline int eg_score(int score){
+    return (short)(unsigned short)((unsigned int)(score + 0x8000) >> 16);
+}
+
+const int phase_weight[12] = { 0, 1, 1, 2, 4, 0,  0, 1, 1, 2, 4, 0 };
+#define max_phase 24
+
+// pawn structure penalties and bonuses
+const int doubled_pawn_penalty = make_score(-10, -20);
+const int isolated_pawn_penalty = make_score(-10, -15);
+const int backward_pawn_penalty = make_score(-8, -10);
+
+// passed pawn bonus [rank from the pawn's side: 0 = first rank, 7 = promotion rank]
+const int passed_pawn_bonus[8] = {
+    make_score(0, 0),   make_score(5, 10),  make_score(10, 20),  make_score(15, 30),
+    make_score(25, 50), make_score(40, 80), make_score(60, 120), make_score(0, 0)
+};
+
+// end game bonus per rank for a passed pawn's path being closer to our king than to theirs
+const int passed_pawn_king_weight[8] = { 0, 0, 0, 1, 2, 3, 5, 0 };
+
+// mobility per attacked square not occupied by own pieces nor attacked by enemy pawns [piece type]
+const int mobility_bonus[6] = {
+    make_score(0, 0), make_score(4, 4), make_score(5, 5), make_score(2, 4), make_score(1, 2), make_score(0, 0)
+};
+
+// king safety: weight of an attack on the king zone [piece type], the penalty is sum^2 / 4 (at most 300)
+const int king_attack_weight[6] = { 1, 2, 2, 3, 5, 0 };
+
+// file masks [square]
+U64 file_masks[64];
+// adjacent files masks [square]
+U64 isolated_masks[64];
+// squares in front of a pawn on its own and adjacent files [side][square]
+U64 passed_masks[2][64];
+// squares on the adjacent files level with or behind a pawn, where a defender could come from [side][square]
+U64 support_masks[2][64];
+
+/*
+      ================================
+            Pawn hash table
+      --------------------------------
+      Pawn structure scores depend on the pawns alone, and pawns
+      rarely move, so they are cached by pawn_key together with the
+      passed pawns and pawn attacks other terms can reuse.
+      ================================
+*/
+typedef struct {
+    U64 pawn_key;
+    int score;              // pawn structure score from white's point of view (packed mid/end game)
+    U64 passed_pawns[2];    // passed pawns [side]
+    U64 pawn_attacks[2];    // squares attacked by pawns [side]
+} pawn_entry;
+
+#define pawn_hash_entries 16384
+
+pawn_entry pawn_hash_table[pawn_hash_entries];
+
+// probes and hits since the last clear, to check the hit rate
+long long pawn_hash_probes, pawn_hash_hits;
+
+void clear_pawn_hash_table(){
+    memset(pawn_hash_table, 0, sizeof(pawn_hash_table));
+    pawn_hash_probes = pawn_hash_hits = 0;
+}
+
+// score the pawn structure of one side, white's point of view
+static inline int evaluate_pawns(int color, pawn_entry* entry){
     int score = 0;
-    U64 bitboard;
-    int piece, square;
+    U64 own_pawns = bitboards[(color == white) ? P : p];
+    U64 enemy_pawns = bitboards[(color == white) ? p : P];
+    U64 bitboard = own_pawns;
 
-    // loop over piece bitboards
-    for (int bb_piece = P; bb_piece <= k; bb_piece++){
-        bitboard = bitboards[bb_piece];
+    while (bitboard){
+        int square = get_ls1b_index(bitboard);
+        int row = square / 8;
 
-        while (bitboard){
- 
-            piece = bb_piece;
-            square = get_ls1b_index(bitboard);
+        entry->pawn_attacks[color] |= pawn_attacks[color][square];
+
+        // doubled: another own pawn on the file (each of them pays)
+        if (count_bits(own_pawns & file_masks[square]) > 1)
+            score += doubled_pawn_penalty;
+
+        // isolated: no own pawns on the adjacent files
+        if ((own_pawns & isolated_masks[square]) == 0)
+            score += isolated_pawn_penalty;
+
+        // backward: no own pawn can defend it and its stop square is held by an enemy pawn
+        else if ((own_pawns & support_masks[color][square]) == 0){
+            int stop_square = (color == white) ? square - 8 : square + 8;
+            if (stop_square >= 0 && stop_square < 64 && (pawn_attacks[color][stop_square] & enemy_pawns))
+                score += backward_pawn_penalty;
+        }
+
+        // passed: no enemy pawn in front on its own and adjacent files
+        if ((enemy_pawns & passed_masks[color][square]) == 0){
+            setSquare(entry->passed_pawns[color], square);
+            score += passed_pawn_bonus[(color == white) ? 7 - row : row];
+        }
+
+        popSquare(bitboard, square);
+    }
+
+    return (color == white) ? score : -score;
+}
+
+// probe the pawn hash table, evaluating the pawn structure on a miss
+static inline pawn_entry* probe_pawn_entry(){
+    pawn_entry* entry = &pawn_hash_table[pawn_key % pawn_hash_entries];
+
+    pawn_hash_probes++;
+
+    // (an empty slot has key 0, which is also the right entry for no pawns at all)
+    if (entry->pawn_key == pawn_key){
+        pawn_hash_hits++;
+        return entry;
+    }
+
+    entry->pawn_key = pawn_key;
+    entry->passed_pawns[white] = entry->passed_pawns[black] = 0ULL;
+    entry->pawn_attacks[white] = entry->pawn_attacks[black] = 0ULL;
+    entry->score = evaluate_pawns(white, entry) + evaluate_pawns(black, entry);
+
+    return entry;
+}
 
+// combine material and positional scores into piece_square_score (make_move keeps psqt_score up to date with it)
+void init_evaluation(){
+    for (int piece = P; piece <= k; piece++){
+        for (int square = 0; square < 64; square++){
             // score material weights
-            score += material_score[piece];
+            int middlegame = material_score[piece];
+            int endgame = material_score[piece];
 
             // score positional piece scores
             switch (piece){
                 // evaluate white pieces
-                case P: score += pawn_score[square]; break;
-                case N: score += knight_score[square]; break;
-                case B: score += bishop_score[square]; break;
-                case R: score += rook_score[square]; break;
-                case K: score += king_score[square]; break;
+                case P: middlegame += pawn_score[square]; endgame += pawn_endgame_score[square]; break;
+                case N: middlegame += knight_score[square]; endgame += knight_score[square]; break;
+                case B: middlegame += bishop_score[square]; endgame += bishop_score[square]; break;
+                case R: middlegame += rook_score[square]; endgame += rook_score[square]; break;
+                case K: middlegame += king_middlegame_score[square]; endgame += king_score[square]; break;
 
                 // evaluate black pieces
-                case p: score -= pawn_score[mirror_score[square]]; break;
-                case n: score -= knight_score[mirror_score[square]]; break;
-                case b: score -= bishop_score[mirror_score[square]]; break;
-                case r: score -= rook_score[mirror_score[square]]; break;
-                case k: score -= king_score[mirror_score[square]]; break;
+                case p: middlegame -= pawn_score[mirror_score[square]]; endgame -= pawn_endgame_score[mirror_score[square]]; break;
+                case n: middlegame -= knight_score[mirror_score[square]]; endgame -= knight_score[mirror_score[square]]; break;
+                case b: middlegame -= bishop_score[mirror_score[square]]; endgame -= bishop_score[mirror_score[square]]; break;
+                case r: middlegame -= rook_score[mirror_score[square]]; endgame -= rook_score[mirror_score[square]]; break;
+                case k: middlegame -= king_middlegame_score[mirror_score[square]]; endgame -= king_score[mirror_score[square]]; break;
             }
 
-            popSquare(bitboard, square);
+            piece_square_score[piece][square] = make_score(middlegame, endgame);
         }
     }
 
-    // return final evaluation based on side
-    return (side == white) ? score : -score;
-}
+    // pawn structure masks
+    for (int square = 0; square < 64; square++){
+        int file = square % 8, row = square / 8;
 
-/**********************************\
- ==================================
+        file_masks[square] = isolated_masks[square] = 0ULL;
+        passed_masks[white][square] = passed_masks[black][square] = 0ULL;
+        support_masks[white][square] = support_masks[black][square] = 0ULL;
 
-               Search
-
- ==================================
-\**********************************/
+        for (int other = 0; other < 64; other++){
+            int other_file = other % 8, other_row = other / 8;
+            int adjacent = (other_file == file - 1 || other_file == file + 1);
 
-// most valuable victim & less valuable attacker
-/*
-
-    (Victims) Pawn Knight Bishop   Rook  Queen   King
-  (Attackers)
-        Pawn   105    205    305    405    505    605
-      Knight   104    204    304    404    504    604
-      Bishop   103    203    303    403    503    603
-        Rook   102    202    302    402    502    602
-       Queen   101    201    301    401    501    601
-        King   100    200    300    400    500    600
+            if (other_file == file) file_masks[square] |= 1ULL << other;
+            if (adjacent) isolated_masks[square] |= 1ULL << other;
 
-*/
+            if (adjacent || other_file == file){
+                // white pawns advance towards row 0, black pawns towards row 7
+                if (other_row < row) passed_masks[white][square] |= 1ULL << other;
+                if (other_row > row) passed_masks[black][square] |= 1ULL << other;
+            }
 
-// MVV LVA [attacker][victim]
-static int mvv_lva[12][12] = {
-    105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
-    104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
-    103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
-    102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
-    101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
-    100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600,
+            if (adjacent){
+                if (other_row >= row) support_masks[white][square] |= 1ULL << other;
+                if (other_row <= row) support_masks[black][square] |= 1ULL << other;
+            }
+        }
+    }
+}
 
-    105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
-    104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
-    103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
-    102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
-    101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
-    100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600
-};
+// chebyshev distance between two squares
+static inline int square_distance(int square1, int square2){
+    return std::max(abs(square1 % 8 - square2 % 8), abs(square1 / 8 - square2 / 8));
+}
 
-#define max_ply 64
+// mobility, king safety and passed pawn terms of one side from the cached attacks, white's point of view
+static inline int evaluate_pieces(int color, attack_info* info, pawn_entry* pawns){
+    int score = 0;
+    int enemy = color ^ 1;
+    int first_piece = (color == white) ? P : p;
+    int enemy_first_piece = (enemy == white) ? P : p;
+
+    // mobility: squares not taken by own pieces nor covered by enemy pawns
+    for (int type = N; type <= Q; type++)
+        score += mobility_bonus[type] * info->mobility[first_piece + type];
+
+    // king safety: enemy attacks on the squares around our king, middle game only
+    int king_square = get_ls1b_index(bitboards[first_piece + K]);
+    int danger = 0;
+    for (int type = P; type <= Q; type++)
+        danger += king_attack_weight[type] * info->king_zone_attacks[enemy_first_piece + type];
+    score -= make_score(std::min(danger * danger / 4, 300), 0);
+
+    // passed pawns: in the end game the kings' distances to the stop square matter
+    int enemy_king_square = get_ls1b_index(bitboards[enemy_first_piece + K]);
+    U64 passed = pawns->passed_pawns[color];
+    while (passed){
+        int square = get_ls1b_index(passed);
+        int rank = (color == white) ? 7 - square / 8 : square / 8;
+        int stop_square = (color == white) ? square - 8 : square + 8;
+
+        score += make_score(0, passed_pawn_king_weight[rank] *
+                           (5 * square_distance(enemy_king_square, stop_square) - 2 * square_distance(king_square, stop_square)));
+
+        popSquare(passed, square);
+    }
 
-// killer moves [id][ply]
-int killer_moves[2][max_ply];
-// history moves [piece][square]
-int history_moves[12][64];
+    return (color == white) ? score : -score;
+}
 
 /*
       ================================
-            Triangular PV table
+             Endgame bitbases
       --------------------------------
-        PV line: e2e4 e7e5 g1f3 b8c6
+      Win, draw or loss for the side to move in every position of an
+      ending with up to 4 pieces, 2 bits each. The index is built
+      from the side to move and the square of each piece, in the
+      order of the ending's code (white's pieces first). Tables are
+      stored with white as the side named first and probed with
+      colors flipped when black is.
+      A table is built backwards: each position first counts its
+      moves staying in the ending, while captures and promotions,
+      leading to other endings, are probed in the tables built
+      before. Then from every decided position the moves are undone:
+      the position before a lost one is won, and a position is lost
+      once all its counted moves reach won ones. The 3-piece tables are built at startup.
+      "genbitbases" builds the 4-piece ones and saves them to
+      BitbasePath, where they are loaded from as file mappings.
       ================================
+*/
+enum { bitbase_draw, bitbase_win, bitbase_loss, bitbase_illegal };
 
-           0    1    2    3    4    5
+#define bitbase_max_pieces 4
 
-      0    m1   m2   m3   m4   m5   m6
+typedef struct {
+    const char* code;               // white's pieces then black's, kings first: "KQKR"
+    int count;                      // pieces
+    int pieces[bitbase_max_pieces]; // piece of each index slot
+    U64 material_key;               // material key with the colors of the code
+    U64 flipped_key;                // and with colors swapped
+    U64 size;                       // positions: 2 * 64^count
+    unsigned char* data;            // 4 positions per byte, nullptr while not built nor loaded
+    HANDLE file, mapping;           // when data is a file mapping
+} bitbase;
+
+// in build order: captures and promotions only lead to endings above
+bitbase bitbases[] = {
+    { "KQK" }, { "KRK" }, { "KPK" },
+    { "KQKR" }, { "KRKB" }, { "KRKN" }, { "KRKR" }, { "KRKP" },
+};
 
-      1    0    m2   m3   m4   m5   m6
+#define bitbase_count ((int)(sizeof(bitbases) / sizeof(bitbases[0])))
 
-      2    0    0    m3   m4   m5   m6
+// the 3-piece tables, built at startup
+#define bitbase_startup_count 3
 
-      3    0    0    0    m4   m5   m6
+// folder of the 4-piece bitbase files (UCI option BitbasePath)
+std::string bitbase_path;
 
-      4    0    0    0    0    m5   m6
+static inline int get_bitbase_value(const unsigned char* data, U64 index){
+    return (data[index >> 2] >> ((index & 3) * 2)) & 3;
+}
 
-      5    0    0    0    0    0    m6
-*/
-// PV length[ply]
-int pv_length[max_ply];
-// PV table[ply][ply]
-int pv_table[max_ply][max_ply];
+static inline void set_bitbase_value(unsigned char* data, U64 index, int value){
+    int shift = (int)(index & 3) * 2;
+    data[index >> 2] = (unsigned char)((data[index >> 2] & ~(3 << shift)) | (value << shift));
+}
 
-// follow PV & score PV move
-int follow_pv, score_pv;
+// the same piece for the other side
+static inline int flip_piece_color(int piece){
+    return (piece < p) ? piece + p : piece - p;
+}
 
-// half move counter
-int ply;
+// squares attacked by a piece standing on a square
+static inline U64 piece_attacks(int piece, int square, U64 occupancy){
+    switch (piece % 6){
+        case P: return pawn_attacks[(piece < p) ? white : black][square];
+        case N: return knight_attacks[square];
+        case B: return get_bishop_attacks(square, occupancy);
+        case R: return get_rook_attacks(square, occupancy);
+        case Q: return get_queen_attacks(square, occupancy);
+        default: return king_attacks[square];
+    }
+}
 
-// enable PV move scoring
-static inline void enable_pv_scoring(moves* move_list){
-    // disable following PV
-    follow_pv = 0;
+// is a square attacked by a side in a position given as a list of pieces
+static inline int list_square_attacked(int count, const int* pieces, const int* squares, int square, int by_side, U64 occupancy){
+    for (int slot = 0; slot < count; slot++){
+        if (((pieces[slot] < p) ? white : black) == by_side && (piece_attacks(pieces[slot], squares[slot], occupancy) & (1ULL << square)))
+            return 1;
+    }
+    return 0;
+}
 
-    for (int count = 0; count < move_list->count; count++){
-        // make sure we hit PV move
-        if (pv_table[0][ply] == move_list->moves[count]){
-            // enable move scoring
-            score_pv = 1;
-            // enable following PV
-            follow_pv = 1;
+// neither side has enough material to mate
+static inline int list_insufficient_material(int count, const int* pieces){
+    int minors[2] = { 0, 0 }, others[2] = { 0, 0 };
+
+    for (int slot = 0; slot < count; slot++){
+        int color = (pieces[slot] < p) ? white : black;
+        int type = pieces[slot] % 6;
+        if (type == N || type == B) minors[color]++;
+        else if (type != K) others[color]++;
+    }
+
+    return others[white] == 0 && others[black] == 0 && minors[white] <= 1 && minors[black] <= 1;
+}
+
+// value for the side to move of a position given as a list of pieces, -1 when no table has it
+static int probe_bitbase_list(int count, const int* pieces, const int* squares, int side_to_move){
+    if (list_insufficient_material(count, pieces))
+        return bitbase_draw;
+
+    U64 key = 0ULL;
+    int counts[12] = { 0 };
+    for (int slot = 0; slot < count; slot++)
+        key ^= material_keys[pieces[slot]][counts[pieces[slot]]++];
+
+    for (int table = 0; table < bitbase_count; table++){
+        bitbase* t = &bitbases[table];
+        if (!t->data || t->count != count) continue;
+
+        int flip;
+        if (key == t->material_key) flip = 0;
+        else if (key == t->flipped_key) flip = 1;
+        else continue;
+
+        // put each piece in the slot of its kind, flipping the board for the other colors
+        U64 index = flip ? side_to_move ^ 1 : side_to_move;
+        int used = 0;
+        for (int slot = 0; slot < count; slot++){
+            for (int given = 0; given < count; given++){
+                int piece = flip ? flip_piece_color(pieces[given]) : pieces[given];
+                if (!(used & (1 << given)) && piece == t->pieces[slot]){
+                    used |= 1 << given;
+                    index = index * 64 + (flip ? squares[given] ^ 56 : squares[given]);
+                    break;
+                }
+            }
         }
+
+        return get_bitbase_value(t->data, index);
     }
+
+    return -1;
 }
 
-/*  =======================
-         Move ordering
-    =======================
+// value of the current position for the side to move, -1 when no table has it
+static inline int probe_bitbase(){
+    int pieces[bitbase_max_pieces], squares[bitbase_max_pieces], count = 0;
 
-    1. PV move
-    2. Captures in MVV/LVA
-    3. 1st killer move
-    4. 2nd killer move
-    5. History moves
-    6. Unsorted moves
-*/
-// score moves
-static inline int score_move(int move){
+    // tables have no castling nor en passant rights
+    if (castle || enpassant != no_sq || count_bits(occupancies[both]) > bitbase_max_pieces)
+        return -1;
 
-    // if PV move scoring is allowed
-    if (score_pv){
-        // make sure we are dealing with PV move
-        if (pv_table[0][ply] == move){
-            // disable score PV flag
-            score_pv = 0;
-            // give PV move the highest score to search it first
-            return 20000;
+    for (int piece = P; piece <= k; piece++){
+        U64 bitboard = bitboards[piece];
+        while (bitboard){
+            int square = get_ls1b_index(bitboard);
+            pieces[count] = piece;
+            squares[count++] = square;
+            popSquare(bitboard, square);
         }
     }
 
-    if (get_move_capture(move)){
-        int target_piece = P;
-        int start_piece, end_piece;
-
-        if (side == white) { start_piece = p; end_piece = k; }
-        else { start_piece = P; end_piece = K; }
-
-        // loop over bitboards opposite to the current side to move
-        for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++){
-            // if there's a piece on the target square
-            if (getSquare(bitboards[bb_piece], get_move_target(move))){
-                // remove it from corresponding bitboard
-                target_piece = bb_piece;
-                break;
+    return probe_bitbase_list(count, pieces, squares, side);
+}
+
+// squares of the pieces and side to move of a table index
+static inline int decode_bitbase_index(const bitbase* t, U64 index, int* squares){
+    for (int slot = t->count - 1; slot >= 0; slot--){
+        squares[slot] = (int)(index & 63);
+        index >>= 6;
+    }
+    return (int)index;
+}
+
+// a position that can't come up in a game: pieces on the same square, pawns on the first or last rank, the side not to move in check
+static int bitbase_position_illegal(const bitbase* t, const int* squares, int side_to_move){
+    U64 occupancy = 0ULL;
+    int king_square[2] = { 0, 0 };
+
+    for (int slot = 0; slot < t->count; slot++){
+        if (occupancy & (1ULL << squares[slot])) return 1;
+        occupancy |= 1ULL << squares[slot];
+
+        if (t->pieces[slot] % 6 == P && (squares[slot] < 8 || squares[slot] >= 56)) return 1;
+        if (t->pieces[slot] == K) king_square[white] = squares[slot];
+        if (t->pieces[slot] == k) king_square[black] = squares[slot];
+    }
+
+    return list_square_attacked(t->count, t->pieces, squares, king_square[side_to_move ^ 1], side_to_move, occupancy);
+}
+
+// index of a table position
+static inline U64 encode_bitbase_index(const bitbase* t, const int* squares, int side_to_move){
+    U64 index = side_to_move;
+    for (int slot = 0; slot < t->count; slot++) index = index * 64 + squares[slot];
+    return index;
+}
+
+// first look at a position: moves into other endings may decide it, the moves staying in the table are counted in pending
+static int init_bitbase_position(const bitbase* t, const int* squares, int side_to_move, int* pending){
+    int count = t->count;
+    const int* pieces = t->pieces;
+    U64 occupancy[2] = { 0ULL, 0ULL };
+    int king_slot = 0;
+
+    for (int slot = 0; slot < count; slot++){
+        occupancy[(pieces[slot] < p) ? white : black] |= 1ULL << squares[slot];
+        if (pieces[slot] == ((side_to_move == white) ? K : k)) king_slot = slot;
+    }
+
+    U64 all = occupancy[white] | occupancy[black];
+    int legal_moves = 0, drawn_exit = 0;
+    *pending = 0;
+
+    for (int slot = 0; slot < count; slot++){
+        int piece = pieces[slot];
+        if (((piece < p) ? white : black) != side_to_move) continue;
+
+        int from = squares[slot];
+        U64 targets;
+
+        if (piece % 6 == P){
+            int step = (side_to_move == white) ? -8 : 8;
+            int start_row = (side_to_move == white) ? 6 : 1;
+            targets = pawn_attacks[side_to_move][from] & occupancy[side_to_move ^ 1];
+            if (!(all & (1ULL << (from + step)))){
+                targets |= 1ULL << (from + step);
+                if (from / 8 == start_row && !(all & (1ULL << (from + 2 * step))))
+                    targets |= 1ULL << (from + 2 * step);
             }
         }
+        else targets = piece_attacks(piece, from, all) & ~occupancy[side_to_move];
+
+        while (targets){
+            int to = get_ls1b_index(targets);
+            popSquare(targets, to);
+
+            // promotions: every piece, an underpromotion may dodge a stalemate
+            int promotion = (piece % 6 == P && (to < 8 || to >= 56));
+            for (int type = (promotion ? Q : 0); type >= (promotion ? N : 0); type--){
+                int new_pieces[bitbase_max_pieces], new_squares[bitbase_max_pieces], new_count = 0;
+                int captured = 0;
+
+                for (int other = 0; other < count; other++){
+                    if (other != slot && squares[other] == to){ captured = 1; continue; }
+                    new_pieces[new_count] = (other == slot && promotion) ? type + ((side_to_move == white) ? 0 : p) : pieces[other];
+                    new_squares[new_count++] = (other == slot) ? to : squares[other];
+                }
 
-        // score move by MVV LVA lookup [source piece][target piece]
-        return mvv_lva[get_move_piece(move)][target_piece] + 10000;
-    }
+                // our king can't be left in check
+                U64 new_occupancy = (all & ~(1ULL << from)) | (1ULL << to);
+                int king_square = (slot == king_slot) ? to : squares[king_slot];
+                if (list_square_attacked(new_count, new_pieces, new_squares, king_square, side_to_move ^ 1, new_occupancy))
+                    continue;
 
-    // score quiet move
-    else{
-        // score 1st killer move
-        if (killer_moves[0][ply] == move)
-            return 9000;
+                legal_moves++;
 
-        // score 2nd killer move
-        else if (killer_moves[1][ply] == move)
-            return 8000;
+                // staying in the table: decided later
+                if (!captured && !promotion){
+                    (*pending)++;
+                    continue;
+                }
 
-        // score history move
-        else
-            return history_moves[get_move_piece(move)][get_move_target(move)];
+                // into another ending, already known (unknown ones count as draws)
+                int value = probe_bitbase_list(new_count, new_pieces, new_squares, side_to_move ^ 1);
+                if (value == bitbase_loss) return bitbase_win;
+                if (value != bitbase_win) drawn_exit = 1;
+            }
+        }
     }
 
-    return 0;
+    // no moves: mate or stalemate
+    if (legal_moves == 0)
+        return list_square_attacked(count, pieces, squares, squares[king_slot], side_to_move ^ 1, all) ? bitbase_loss : bitbase_draw;
+
+    // every move loses
+    if (*pending == 0 && !drawn_exit)
+        return bitbase_loss;
+
+    // a drawing way out: never lost, whatever the other moves turn out to be
+    *pending += drawn_exit;
+    return bitbase_draw;
 }
 
-// sort moves TBD improve sorting algo
-static inline void sort_moves(moves* move_list){
-    // move scores
-    std::vector<int> move_scores(move_list->count);
+// split a table's positions over threads, 64 at a time: work(first, last) on indexes
+template <typename F>
+static void bitbase_parallel(const bitbase* t, int threads, F work){
+    std::vector<std::thread> workers;
+    U64 blocks = t->size / 64;
 
-    for (int count = 0; count < move_list->count; count++)
-        move_scores[count] = score_move(move_list->moves[count]);
-   
-    //sort
-    for (int current_move = 0; current_move < move_list->count; current_move++){
-        for (int next_move = current_move + 1; next_move < move_list->count; next_move++){
-            // compare current and next move scores
-            if (move_scores[current_move] < move_scores[next_move]){
-                // swap scores
-                int temp_score = move_scores[current_move];
-                move_scores[current_move] = move_scores[next_move];
-                move_scores[next_move] = temp_score;
+    for (int thread = 0; thread < threads; thread++)
+        workers.emplace_back(work, blocks * thread / threads * 64, blocks * (thread + 1) / threads * 64);
 
-                // swap moves
-                int temp_move = move_list->moves[current_move];
-                move_list->moves[current_move] = move_list->moves[next_move];
-                move_list->moves[next_move] = temp_move;
+    for (auto& worker : workers) worker.join();
+}
+
+// build a table in memory
+static void generate_bitbase(bitbase* t, int threads){
+    unsigned char* data = (unsigned char*)calloc((size_t)(t->size / 4), 1);
+
+    // moves staying in the table not known yet to lose [position], and the positions decided in the last round
+    std::vector<unsigned char> pending((size_t)t->size);
+    std::vector<U64> decided((size_t)(t->size / 64)), next_decided((size_t)(t->size / 64));
+
+    // every position on its own first, split over threads
+    bitbase_parallel(t, threads, [&](U64 first, U64 last){
+        int squares[bitbase_max_pieces];
+        for (U64 index = first; index < last; index++){
+            int side_to_move = decode_bitbase_index(t, index, squares);
+
+            if (bitbase_position_illegal(t, squares, side_to_move)){
+                set_bitbase_value(data, index, bitbase_illegal);
+                continue;
+            }
+
+            int moves;
+            int value = init_bitbase_position(t, squares, side_to_move, &moves);
+            pending[index] = (unsigned char)moves;
+
+            if (value != bitbase_draw){
+                set_bitbase_value(data, index, value);
+                decided[index / 64] |= 1ULL << (index % 64);
+            }
+        }
+    });
+
+    // then back from the decided positions to the ones that move into them:
+    // a move into a lost position wins, a position whose moves all reach won ones is lost
+    int any_decided = 1;
+    while (any_decided){
+        any_decided = 0;
+
+        for (U64 word = 0; word < decided.size(); word++){
+            while (decided[word]){
+                int bit = get_ls1b_index(decided[word]);
+                popSquare(decided[word], bit);
+
+                U64 index = word * 64 + bit;
+                int squares[bitbase_max_pieces];
+                int side_to_move = decode_bitbase_index(t, index, squares);
+                int value = get_bitbase_value(data, index);
+                int mover = side_to_move ^ 1;
+
+                U64 occupancy = 0ULL;
+                for (int slot = 0; slot < t->count; slot++) occupancy |= 1ULL << squares[slot];
+
+                // undo a move of the side that just moved (no captures nor promotions: those came from other endings)
+                for (int slot = 0; slot < t->count; slot++){
+                    int piece = t->pieces[slot];
+                    if (((piece < p) ? white : black) != mover) continue;
+
+                    int to = squares[slot];
+                    U64 sources;
+
+                    if (piece % 6 == P){
+                        int step = (mover == white) ? 8 : -8;
+                        int back = to + step;
+                        sources = 0ULL;
+                        if (back >= 8 && back < 56 && !(occupancy & (1ULL << back))){
+                            sources |= 1ULL << back;
+                            if (to / 8 == ((mover == white) ? 4 : 3) && !(occupancy & (1ULL << (back + step))))
+                                sources |= 1ULL << (back + step);
+                        }
+                    }
+                    else sources = piece_attacks(piece, to, occupancy) & ~occupancy;
+
+                    while (sources){
+                        int from = get_ls1b_index(sources);
+                        popSquare(sources, from);
+
+                        squares[slot] = from;
+                        U64 previous = encode_bitbase_index(t, squares, mover);
+                        squares[slot] = to;
+
+                        if (get_bitbase_value(data, previous) != bitbase_draw) continue;
+
+                        if (value == bitbase_loss || --pending[previous] == 0){
+                            set_bitbase_value(data, previous, (value == bitbase_loss) ? bitbase_win : bitbase_loss);
+                            next_decided[previous / 64] |= 1ULL << (previous % 64);
+                            any_decided = 1;
+                        }
+                    }
+                }
             }
         }
+
+        decided.swap(next_decided);
     }
+
+    t->data = data;
 }
 
-//quiesence search
-static inline int quiescence(int alpha, int beta) {
-    // every 2047 nodes
-    if ((nodes & 2047) == 0)
-        // "listen" to the GUI/user input
-        communicate();
+// fill in the pieces and keys of the tables from their codes
+void init_bitbase_codes(){
+    for (int table = 0; table < bitbase_count; table++){
+        bitbase* t = &bitbases[table];
+        int color = white, counts[12] = { 0 }, flipped_counts[12] = { 0 };
 
-    nodes++;
-    int evaluation = evaluate();
-    if (evaluation >= beta){
-        // node (move) fails high
-        return beta;
+        t->count = 0;
+        t->material_key = t->flipped_key = 0ULL;
+
+        for (const char* letter = t->code; *letter; letter++){
+            // the second king starts black's pieces
+            if (*letter == 'K' && letter != t->code) color = black;
+
+            int piece = char_pieces[*letter] + ((color == white) ? 0 : p);
+            t->pieces[t->count++] = piece;
+            t->material_key ^= material_keys[piece][counts[piece]++];
+            t->flipped_key ^= material_keys[flip_piece_color(piece)][flipped_counts[flip_piece_color(piece)]++];
+        }
+
+        t->size = 2;
+        for (int slot = 0; slot < t->count; slot++) t->size *= 64;
     }
+}
 
-    // found a better move
-    if (evaluation > alpha){
-        // PV node (move)
-        alpha = evaluation;
+// free or unmap a table
+static void unload_bitbase(bitbase* t){
+    if (t->mapping){
+        UnmapViewOfFile(t->data);
+        CloseHandle(t->mapping);
+        CloseHandle(t->file);
     }
+    else free(t->data);
 
-    moves move_list[1];
-    generate_moves(move_list);
-    sort_moves(move_list);
+    t->data = nullptr;
+    t->file = t->mapping = nullptr;
+}
 
-    // loop over moves within a movelist
-    for (int count = 0; count < move_list->count; count++){
-        copy_board();
-        ply++;
-        if (make_move(move_list->moves[count], only_captures) == 0){
-            // decrement ply
-            ply--;
+static std::string bitbase_file_name(const bitbase* t){
+    std::string name = bitbase_path;
+    if (!name.empty() && name.back() != '\\' && name.back() != '/') name += '\\';
+    return name + t->code + ".bb";
+}
+
+// map a table's file from BitbasePath, 1 if it's there
+static int load_bitbase(bitbase* t){
+    std::string name = bitbase_file_name(t);
+
+    HANDLE file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || (U64)file_size.QuadPart != t->size / 4){
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view){
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+
+    t->file = file;
+    t->mapping = mapping;
+    t->data = (unsigned char*)view;
+    return 1;
+}
+
+// (re)load the 4-piece tables found in BitbasePath
+void load_bitbases(){
+    int loaded = 0;
+
+    for (int table = bitbase_startup_count; table < bitbase_count; table++){
+        if (bitbases[table].data) unload_bitbase(&bitbases[table]);
+        loaded += load_bitbase(&bitbases[table]);
+    }
+
+    std::cout << "info string " << loaded << " of " << bitbase_count - bitbase_startup_count << " bitbases loaded" << std::endl;
+}
+
+// build the 4-piece tables that aren't loaded, saving them to BitbasePath
+void generate_bitbases(int threads){
+    for (int table = bitbase_startup_count; table < bitbase_count; table++){
+        bitbase* t = &bitbases[table];
+        if (t->data) continue;
+
+        long long start = get_time_ms();
+        generate_bitbase(t, threads);
+
+        FILE* file = nullptr;
+        std::string name = bitbase_file_name(t);
+        fopen_s(&file, name.c_str(), "wb");
+        if (file){
+            fwrite(t->data, 1, (size_t)(t->size / 4), file);
+            fclose(file);
+        }
+
+        std::cout << "info string " << t->code << " built in " << get_time_ms() - start << " ms"
+                  << (file ? ", saved to " + name : ", not saved") << std::endl;
+    }
+}
+
+// the 3-piece tables, needed by KPK and by the 4-piece ones
+void init_bitbases(){
+    init_bitbase_codes();
+
+    for (int table = 0; table < bitbase_startup_count; table++)
+        generate_bitbase(&bitbases[table], std::max((int)std::thread::hardware_concurrency(), 1));
+}
+
+/*
+      ================================
+             Endgame knowledge
+      --------------------------------
+      material_key hashes the piece counts alone, so it names the
+      material signature (KBNK, KPK, ...). The material table caches
+      what is known about each signature: a specialized evaluation
+      for endings the generic one gets wrong, and how much each
+      side's advantage is worth (scale, out of scale_normal), 0 when
+      that side can't win at all. When neither side can, the
+      position is a dead draw.
+      ================================
+*/
+
+// score of a won ending, above any material count and below the mate scores
+#define known_win 10000
+
+#define scale_normal 64
+
+// specialized evaluation / scale factor, from the strong side's point of view
+typedef int (*endgame_function)(int strong);
+
+typedef struct {
+    endgame_function function;
+    int strong;                         // side the function is for
+} endgame_entry;
+
+// specialized evaluations by material key, filled by init_endgames()
+std::unordered_map<U64, endgame_entry> endgame_evaluations;
+
+typedef struct {
+    U64 material_key;
+    endgame_function evaluate;          // specialized evaluation, nullptr for the generic one
+    int evaluate_side;                  // side evaluate is for
+    endgame_function scale_function[2]; // scale factor depending on the position [side], capped by scale[side]
+    int scale[2];                       // scale factor of each side's advantage [side]
+    int draw;                           // neither side can win
+} material_entry;
+
+#define material_hash_entries 1024
+
+material_entry material_hash_table[material_hash_entries];
+
+void clear_material_hash_table(){
+    memset(material_hash_table, 0, sizeof(material_hash_table));
+}
+
+// flip a square so the strong side's pawns move up the board (towards row 0) as white's do
+static inline int relative_square(int strong, int square){
+    return (strong == white) ? square : square ^ 56;
+}
+
+// how far from the center a square is: 0 for d4, e4, d5, e5 and 6 for the corners
+static inline int center_distance(int square){
+    int file = square % 8, row = square / 8;
+    return std::max(3 - file, file - 4) + std::max(3 - row, row - 4);
+}
+
+// manhattan distance between two squares
+static inline int manhattan_distance(int square1, int square2){
+    return abs(square1 % 8 - square2 % 8) + abs(square1 / 8 - square2 / 8);
+}
+
+// material of one side, kings left out
+static inline int side_material(int color){
+    int first_piece = (color == white) ? P : p;
+    int material = 0;
+
+    for (int type = P; type <= Q; type++)
+        material += material_score[type] * count_bits(bitboards[first_piece + type]);
+
+    return material;
+}
+
+// enough material to mate a bare king: drive it to the edge and bring the king closer
+static int evaluate_kxk(int strong){
+    int strong_king = get_ls1b_index(bitboards[(strong == white) ? K : k]);
+    int weak_king = get_ls1b_index(bitboards[(strong == white) ? k : K]);
+
+    return known_win + side_material(strong)
+         + 20 * center_distance(weak_king) + 10 * (7 - square_distance(strong_king, weak_king));
+}
+
+// bishop and knight: the mate is only in a corner of the bishop's color
+static int evaluate_kbnk(int strong){
+    int strong_king = get_ls1b_index(bitboards[(strong == white) ? K : k]);
+    int weak_king = get_ls1b_index(bitboards[(strong == white) ? k : K]);
+    int bishop_square = get_ls1b_index(bitboards[(strong == white) ? B : b]);
+
+    // a8 and h1 are light squares, a1 and h8 dark ones
+    int light = ((bishop_square / 8 + bishop_square % 8) % 2 == 0);
+    int corner_distance = light ? std::min(manhattan_distance(weak_king, a8), manhattan_distance(weak_king, h1))
+                                : std::min(manhattan_distance(weak_king, a1), manhattan_distance(weak_king, h8));
+
+    return known_win + side_material(strong)
+         + 20 * (14 - corner_distance) + 10 * (7 - square_distance(strong_king, weak_king));
+}
+
+// score of a position won for the strong side: material, then the weak king on the edge, ours close and the pawns far up
+static int bitbase_win_score(int strong){
+    int strong_king = get_ls1b_index(bitboards[(strong == white) ? K : k]);
+    int weak_king = get_ls1b_index(bitboards[(strong == white) ? k : K]);
+    int score = known_win + side_material(strong) - side_material(strong ^ 1)
+              + 20 * center_distance(weak_king) + 10 * (7 - square_distance(strong_king, weak_king));
+
+    U64 pawns = bitboards[(strong == white) ? P : p];
+    while (pawns){
+        int square = get_ls1b_index(pawns);
+        score += 10 * (7 - relative_square(strong, square) / 8);
+        popSquare(pawns, square);
+    }
+
+    return score;
+}
+
+// king and pawn against king: exact from the bitbase
+static int evaluate_kpk(int strong){
+    int result = probe_bitbase();
+    int won = (side == strong) ? (result == bitbase_win) : (result == bitbase_loss);
+
+    return won ? bitbase_win_score(strong) : 0;
+}
+
+// opposite colored bishops and pawns only: hard to win even a pawn or two up
+static int scale_opposite_bishops(int strong){
+    int light_white = ((get_ls1b_index(bitboards[B]) / 8 + get_ls1b_index(bitboards[B]) % 8) % 2 == 0);
+    int light_black = ((get_ls1b_index(bitboards[b]) / 8 + get_ls1b_index(bitboards[b]) % 8) % 2 == 0);
+
+    return (light_white != light_black) ? scale_normal / 4 : scale_normal;
+}
+
+// bishop and rook pawns against a bare king: a draw when the bishop can't cover the corner and the king is there
+static int scale_wrong_bishop(int strong){
+    U64 pawns = bitboards[(strong == white) ? P : p];
+    int weak_king = relative_square(strong, get_ls1b_index(bitboards[(strong == white) ? k : K]));
+    int bishop_square = relative_square(strong, get_ls1b_index(bitboards[(strong == white) ? B : b]));
+
+    // all the pawns on one rook file
+    int file;
+    if ((pawns & ~file_masks[a8]) == 0) file = 0;
+    else if ((pawns & ~file_masks[h8]) == 0) file = 7;
+    else return scale_normal;
+
+    // both squares are flipped alike, so their colors still compare
+    int promotion = file;
+    int bishop_light = ((bishop_square / 8 + bishop_square % 8) % 2 == 0);
+    int promotion_light = ((promotion / 8 + promotion % 8) % 2 == 0);
+
+    if (bishop_light != promotion_light && square_distance(weak_king, promotion) <= 1)
+        return 0;
+
+    return scale_normal;
+}
+
+// register a specialized evaluation for a signature like "KBNK" (strong side first), for both colors
+static void add_endgame(const char* code, endgame_function function){
+    for (int strong = white; strong <= black; strong++){
+        int counts[12] = { 0 };
+        int color = strong;
+
+        for (const char* letter = code; *letter; letter++){
+            // the second king starts the weak side
+            if (*letter == 'K' && letter != code) color = strong ^ 1;
+            int type = char_pieces[*letter];
+            counts[type + ((color == white) ? 0 : p)]++;
+        }
+
+        U64 key = 0ULL;
+        for (int piece = P; piece <= k; piece++){
+            for (int count = 0; count < counts[piece]; count++)
+                key ^= material_keys[piece][count];
+        }
+
+        endgame_entry entry = { function, strong };
+        endgame_evaluations[key] = entry;
+    }
+}
+
+void init_endgames(){
+    endgame_evaluations.clear();
+    add_endgame("KBNK", evaluate_kbnk);
+    add_endgame("KPK", evaluate_kpk);
+    clear_material_hash_table();
+}
+
+// probe the material table, working out what the signature means on a miss
+static inline material_entry* probe_material_entry(){
+    material_entry* entry = &material_hash_table[material_key % material_hash_entries];
+
+    if (entry->material_key == material_key)
+        return entry;
+
+    memset(entry, 0, sizeof(material_entry));
+    entry->material_key = material_key;
+
+    int pawns[2], minors[2], knights[2], bishops[2], majors[2], pieces[2];
+    for (int color = white; color <= black; color++){
+        int first_piece = (color == white) ? P : p;
+        pawns[color] = count_bits(bitboards[first_piece + P]);
+        knights[color] = count_bits(bitboards[first_piece + N]);
+        bishops[color] = count_bits(bitboards[first_piece + B]);
+        minors[color] = knights[color] + bishops[color];
+        majors[color] = count_bits(bitboards[first_piece + R] | bitboards[first_piece + Q]);
+        pieces[color] = side_material(color) - pawns[color] * material_score[P];
+    }
+
+    // specialized evaluation for this exact signature
+    auto found = endgame_evaluations.find(material_key);
+    if (found != endgame_evaluations.end()){
+        entry->evaluate = found->second.function;
+        entry->evaluate_side = found->second.strong;
+    }
+
+    for (int color = white; color <= black; color++){
+        int enemy = color ^ 1;
+
+        // mating material against a bare king
+        if (!entry->evaluate && pawns[enemy] == 0 && pieces[enemy] == 0 &&
+            (majors[color] || bishops[color] >= 2 || (bishops[color] && knights[color]))){
+            entry->evaluate = evaluate_kxk;
+            entry->evaluate_side = color;
+        }
+
+        entry->scale[color] = scale_normal;
+
+        // without pawns a minor piece, or two knights against a bare king, can't mate
+        if (pawns[color] == 0){
+            if (majors[color] == 0 && (minors[color] <= 1 || (knights[color] == 2 && bishops[color] == 0 && pawns[enemy] == 0 && pieces[enemy] == 0)))
+                entry->scale[color] = 0;
+
+            // nor can a minor piece more than the opponent, most of the time
+            else if (pieces[color] - pieces[enemy] <= material_score[B])
+                entry->scale[color] = scale_normal / 4;
+        }
+
+        // bishop and pawns against a bare king
+        if (bishops[color] == 1 && knights[color] == 0 && majors[color] == 0 && pawns[color] && pawns[enemy] == 0 && pieces[enemy] == 0)
+            entry->scale_function[color] = scale_wrong_bishop;
+
+        // a bishop each and pawns
+        if (bishops[color] == 1 && bishops[enemy] == 1 && knights[color] + knights[enemy] + majors[color] + majors[enemy] == 0)
+            entry->scale_function[color] = scale_opposite_bishops;
+    }
+
+    entry->draw = (entry->scale[white] == 0 && entry->scale[black] == 0);
+
+    return entry;
+}
+
+//position evaluation returns score from the side to move's perspective
+static inline int evaluate(){
+    // known endings first: dead draws and specialized evaluations
+    material_entry* material = probe_material_entry();
+    if (material->draw)
+        return 0;
+
+    if (material->evaluate){
+        int score = material->evaluate(material->evaluate_side);
+        return (side == material->evaluate_side) ? score : -score;
+    }
+
+    // If neural evaluation is enabled and initialized, use it
+    if (nn_is_enabled()) {
+        // nn_value_cp() is defined from side-to-move perspective already
+        return nn_value_cp();
+    }
+
+    // material + positional score, kept incrementally by make_move
+    int score = psqt_score;
+
+    // pawn structure, cached by pawn key
+    pawn_entry* pawns = probe_pawn_entry();
+    score += pawns->score;
+
+    // piece terms from the attacks cached for this ply
+    attack_info* info = get_attack_info();
+    score += evaluate_pieces(white, info, pawns) + evaluate_pieces(black, info, pawns);
+
+    // game phase from the pieces left
+    int phase = 0;
+    for (int piece = N; piece <= Q; piece++)
+        phase += phase_weight[piece] * count_bits(bitboards[piece] | bitboards[piece + p]);
+    phase = std::min(phase, max_phase);
+
+    // blend middle and end game
+    score = (mg_score(score) * phase + eg_score(score) * (max_phase - phase)) / max_phase;
+
+    // scale down an advantage the material says is hard to convert
+    int strong = (score > 0) ? white : black;
+    int scale = material->scale[strong];
+    if (material->scale_function[strong]) scale = std::min(material->scale_function[strong](strong), scale);
+    score = score * scale / scale_normal;
+
+    // return final evaluation based on side
+    return (side == white) ? score : -score;
+}
+
+/**********************************\
+ ==================================
+
+     Static exchange evaluation
+
+ ==================================
+\**********************************/
+
+// piece values for exchanges [piece], the king can't be traded
+const int see_value[12] = {
+    100, 300, 350, 500, 1000, 20000,
+    100, 300, 350, 500, 1000, 20000
+};
+
+// piece standing on the target square of a capture (a pawn for enpassant)
+static inline int get_captured_piece(int move){
+    int start_piece, end_piece;
+
+    if (side == white) { start_piece = p; end_piece = k; }
+    else { start_piece = P; end_piece = K; }
+
+    // loop over bitboards opposite to the current side to move
+    for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++)
+        if (getSquare(bitboards[bb_piece], get_move_target(move)))
+            return bb_piece;
+
+    // enpassant: the square is empty, the victim is a pawn
+    return (side == white) ? p : P;
+}
+
+/*
+    Does the exchange sequence started by move gain at least threshold?
+
+    Both sides keep recapturing on the target square with their least
+    valuable attacker; after every capture the slider attacks are
+    recomputed with the new occupancy, so x-ray attackers behind the
+    piece that just moved join in. Pins and checks are ignored.
+*/
+static inline int see(int move, int threshold){
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+
+    // what we win if the piece we move is left alone
+    int swap = (get_move_capture(move) ? see_value[get_captured_piece(move)] : 0) - threshold;
+    if (swap < 0) return 0;
+
+    // what we still have if the piece we move is taken back
+    swap = see_value[get_move_piece(move)] - swap;
+    if (swap <= 0) return 1;
+
+    U64 occupancy = occupancies[both] ^ (1ULL << source_square);
+
+    // enpassant: the captured pawn is not on the target square
+    if (get_move_enpassant(move))
+        occupancy ^= 1ULL << ((side == white) ? target_square + 8 : target_square - 8);
+
+    attack_info* info = get_attack_info();
+
+    U64 diagonal = bitboards[B] | bitboards[b] | bitboards[Q] | bitboards[q];
+    U64 straight = bitboards[R] | bitboards[r] | bitboards[Q] | bitboards[q];
+    U64 attackers = attackers_to(target_square, occupancy);
+
+    int stm = side;
+    int result = 1;
+
+    while (1){
+        stm ^= 1;
+        attackers &= occupancy;
+
+        U64 stm_attackers = attackers & occupancies[stm];
+
+        // pinned pieces can't recapture while their pinner is still on the board
+        if (info->pinners[stm ^ 1] & occupancy)
+            stm_attackers &= ~info->pinned[stm];
+
+        if (!stm_attackers) break;
+
+        result ^= 1;
+
+        // least valuable attacker of the side to recapture
+        int piece = (stm == white) ? P : p;
+        while (!(stm_attackers & bitboards[piece])) piece++;
+
+        // a king can only recapture if the other side has nothing left
+        if (piece == K || piece == k)
+            return (attackers & occupancies[stm ^ 1]) ? result ^ 1 : result;
+
+        swap = see_value[piece] - swap;
+        if (swap < result) break;
+
+        // remove the capturing piece from the board
+        U64 attacker = bitboards[piece] & stm_attackers;
+        occupancy ^= attacker & (0ULL - attacker);
+
+        // reveal x-ray attackers behind the piece that just captured
+        if (piece == P || piece == p || piece == B || piece == b || piece == Q || piece == q)
+            attackers |= get_bishop_attacks(target_square, occupancy) & diagonal;
+        if (piece == R || piece == r || piece == Q || piece == q)
+            attackers |= get_rook_attacks(target_square, occupancy) & straight;
+    }
+
+    return result;
+}
+
+/**********************************\
+ ==================================
+
+         Transposition table
+
+ ==================================
+\**********************************/
+
+// score bounds: mate scores are mate_value - ply, anything beyond mate_score is a forced mate
+#define infinity 50000
+#define mate_value 49000
+#define mate_score 48000
+
+// hash flags: exact score, upper bound (failed low) or lower bound (failed high)
+#define hash_flag_exact 0
+#define hash_flag_alpha 1
+#define hash_flag_beta  2
+
+// transposition table entry
+typedef struct {
+    U64 hash_key;   // full position key to detect index collisions
+    int depth;      // remaining depth the entry was searched with
+    int flag;       // hash_flag_exact / hash_flag_alpha / hash_flag_beta
+    int score;      // fail-soft score, mate scores relative to this node
+    int best_move;  // best (or refutation) move, 0 if none
+} tt;
+
+// "Hash" UCI option (MB)
+int hash_size_mb = 64;
+
+// transposition table and its number of entries
+tt* hash_table = NULL;
+int hash_entries = 0;
+
+// clear the TT (new game, bench)
+void clear_hash_table(){
+    if (hash_table) memset(hash_table, 0, sizeof(tt) * hash_entries);
+}
+
+// (re)allocate the TT with the given size in MB
+void init_hash_table(int mb){
+    free(hash_table);
+
+    hash_entries = (int)(((long long)mb * 0x100000) / sizeof(tt));
+    hash_table = (tt*)malloc(sizeof(tt) * hash_entries);
+
+    // fall back to a smaller table if the allocation failed
+    if (hash_table == NULL){
+        std::cout << "info string couldn't allocate " << mb << "MB hash, trying " << mb / 2 << "MB\n";
+        init_hash_table(std::max(mb / 2, 1));
+        return;
+    }
+
+    clear_hash_table();
+}
+
+// look the current position up, NULL if it isn't stored
+static inline tt* probe_hash_entry(){
+    tt* entry = &hash_table[hash_key % hash_entries];
+    return (entry->hash_key == hash_key) ? entry : NULL;
+}
+
+// mate scores are stored relative to the node, and read back relative to the root
+static inline int score_from_tt(int score, int ply){
+    if (score < -mate_score) return score + ply;
+    if (score > mate_score) return score - ply;
+    return score;
+}
+
+static inline int score_to_tt(int score, int ply){
+    if (score < -mate_score) return score - ply;
+    if (score > mate_score) return score + ply;
+    return score;
+}
+
+// store a search result (always replace, but keep the old move if we have none)
+static inline void write_hash_entry(int score, int best_move, int depth, int hash_flag, int ply){
+    tt* entry = &hash_table[hash_key % hash_entries];
+
+    if (best_move == 0 && entry->hash_key == hash_key)
+        best_move = entry->best_move;
+
+    entry->hash_key = hash_key;
+    entry->score = score_to_tt(score, ply);
+    entry->flag = hash_flag;
+    entry->depth = depth;
+    entry->best_move = best_move;
+}
+
+/**********************************\
+ ==================================
+
+               Search
+
+ ==================================
+\**********************************/
+
+// most valuable victim & less valuable attacker
+/*
+
+    (Victims) Pawn Knight Bishop   Rook  Queen   King
+  (Attackers)
+        Pawn   105    205    305    405    505    605
+      Knight   104    204    304    404    504    604
+      Bishop   103    203    303    403    503    603
+        Rook   102    202    302    402    502    602
+       Queen   101    201    301    401    501    601
+        King   100    200    300    400    500    600
+
+*/
+
+// MVV LVA [attacker][victim]
+static int mvv_lva[12][12] = {
+    105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
+    104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
+    103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
+    102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
+    101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
+    100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600,
+
+    105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
+    104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
+    103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
+    102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
+    101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
+    100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600
+};
+
+
+// killer moves [id][ply]
+int killer_moves[2][max_ply];
+
+/*
+      ================================
+            History heuristics
+      --------------------------------
+      Kept between the moves of a game, cleared by ucinewgame.
+      Every update is a gravity update: the entry moves towards
+      +-history_max by bonus and is pulled back the more it already
+      holds, so it stays bounded and old results fade away. A cutoff
+      gives the move a bonus and the moves tried before it a malus.
+      ================================
+*/
+#define history_max 16384
+
+// history moves [piece][square]
+int history_moves[12][64];
+// counter moves [previous piece][previous target]: quiet move that refuted it last time
+int counter_moves[12][64];
+// continuation history [previous piece][previous target][piece][target], for 1 and 2 plies back
+int continuation_history[12][64][12][64];
+// capture history [piece][target][captured piece type]
+int capture_history[12][64][6];
+
+// move that led to each ply (0 for a null move)
+int move_stack[max_ply + 1];
+
+/*
+      ================================
+            Triangular PV table
+      --------------------------------
+        PV line: e2e4 e7e5 g1f3 b8c6
+      ================================
+
+           0    1    2    3    4    5
+
+      0    m1   m2   m3   m4   m5   m6
+
+      1    0    m2   m3   m4   m5   m6
+
+      2    0    0    m3   m4   m5   m6
+
+      3    0    0    0    m4   m5   m6
+
+      4    0    0    0    0    m5   m6
+
+      5    0    0    0    0    0    m6
+*/
+// PV length[ply]
+int pv_length[max_ply];
+// PV table[ply][ply]
+int pv_table[max_ply][max_ply];
+
+// follow PV & score PV move
+int follow_pv, score_pv;
+
+/*
+      ================================
+               MultiPV lines
+      --------------------------------
+      Line k is found by searching the root again while skipping the best
+      moves of lines 0..k-1, so every pass reuses the killers/history (and
+      cutoffs) built by the previous ones.
+      ================================
+*/
+#define max_multi_pv 64
+
+// "MultiPV" UCI option: number of root lines to report
+int multi_pv = 1;
+
+typedef struct {
+    int score;
+    // average absolute score change between iterations, widens the aspiration window
+    int volatility;
+    int length;
+    int moves[max_ply];
+} pv_line;
+
+// best root lines from the last completed passes, best first
+pv_line pv_lines[max_multi_pv];
+
+// root moves skipped by negamax (best moves of the lines found so far in this iteration)
+int root_excluded[max_multi_pv];
+int root_excluded_count;
+
+static inline int is_root_excluded(int move){
+    for (int index = 0; index < root_excluded_count; index++)
+        if (root_excluded[index] == move) return 1;
+
+    return 0;
+}
+
+
+static inline void clear_history(){
+    memset(history_moves, 0, sizeof(history_moves));
+    memset(counter_moves, 0, sizeof(counter_moves));
+    memset(continuation_history, 0, sizeof(continuation_history));
+    memset(capture_history, 0, sizeof(capture_history));
+}
+
+static inline int history_bonus(int depth){
+    return std::min(32 * depth * depth, 1200);
+}
+
+static inline void update_history(int* entry, int bonus){
+    *entry += bonus - *entry * abs(bonus) / history_max;
+}
+
+// quiet move history: main history plus continuation history of the last two moves
+static inline int quiet_history(int move){
+    int piece = get_move_piece(move), target = get_move_target(move);
+    int score = history_moves[piece][target];
+
+    int previous = move_stack[ply];
+    if (previous) score += continuation_history[get_move_piece(previous)][get_move_target(previous)][piece][target];
+
+    int before_previous = ply ? move_stack[ply - 1] : 0;
+    if (before_previous) score += continuation_history[get_move_piece(before_previous)][get_move_target(before_previous)][piece][target];
+
+    return score;
+}
+
+static inline void update_quiet_history(int move, int bonus){
+    int piece = get_move_piece(move), target = get_move_target(move);
+    update_history(&history_moves[piece][target], bonus);
+
+    int previous = move_stack[ply];
+    if (previous) update_history(&continuation_history[get_move_piece(previous)][get_move_target(previous)][piece][target], bonus);
+
+    int before_previous = ply ? move_stack[ply - 1] : 0;
+    if (before_previous) update_history(&continuation_history[get_move_piece(before_previous)][get_move_target(before_previous)][piece][target], bonus);
+}
+
+static inline int* capture_history_entry(int move){
+    return &capture_history[get_move_piece(move)][get_move_target(move)][get_captured_piece(move) % 6];
+}
+
+// quiet move that refuted the previous move last time
+static inline int counter_move(){
+    int previous = move_stack[ply];
+    return previous ? counter_moves[get_move_piece(previous)][get_move_target(previous)] : 0;
+}
+
+// enable PV move scoring
+static inline void enable_pv_scoring(moves* move_list){
+    // disable following PV
+    follow_pv = 0;
+
+    for (int count = 0; count < move_list->count; count++){
+        // make sure we hit PV move
+        if (pv_table[0][ply] == move_list->moves[count]){
+            // enable move scoring
+            score_pv = 1;
+            // enable following PV
+            follow_pv = 1;
+        }
+    }
+}
+
+/*  =======================
+         Move ordering
+    =======================
+
+    1. TT move
+    2. PV move
+    3. Good captures (SEE >= 0) in MVV/LVA, then capture history
+    4. 1st killer move
+    5. 2nd killer move
+    6. Counter move
+    7. History + continuation history
+    8. Bad captures (SEE < 0)
+*/
+// score moves
+static inline int score_move(int move){
+
+    // if PV move scoring is allowed
+    if (score_pv){
+        // make sure we are dealing with PV move
+        if (pv_table[0][ply] == move){
+            // disable score PV flag
+            score_pv = 0;
+            // give PV move the highest score to search it first
+            return 2000000;
+        }
+    }
+
+    if (get_move_capture(move)){
+        // score move by MVV LVA lookup [source piece][target piece], capture history breaks ties
+        int score = mvv_lva[get_move_piece(move)][get_captured_piece(move)] * 32 + *capture_history_entry(move) / 8;
+
+        // losing captures go after the quiet moves
+        return see(move, 0) ? score + 1000000 : score - 1000000;
+    }
+
+    // score quiet move
+    else{
+        // score 1st killer move
+        if (killer_moves[0][ply] == move)
+            return 900000;
+
+        // score 2nd killer move
+        else if (killer_moves[1][ply] == move)
+            return 800000;
+
+        // score counter move
+        else if (counter_move() == move)
+            return 700000;
+
+        // score history move
+        else
+            return quiet_history(move);
+    }
+
+    return 0;
+}
+
+// sort moves TBD improve sorting algo
+static inline void sort_moves(moves* move_list, int best_move){
+    // move scores
+    std::vector<int> move_scores(move_list->count);
+
+    for (int count = 0; count < move_list->count; count++){
+        move_scores[count] = score_move(move_list->moves[count]);
+
+        // TT move goes first, above the PV move
+        if (move_list->moves[count] == best_move)
+            move_scores[count] = 3000000;
+    }
+   
+    //sort
+    for (int current_move = 0; current_move < move_list->count; current_move++){
+        for (int next_move = current_move + 1; next_move < move_list->count; next_move++){
+            // compare current and next move scores
+            if (move_scores[current_move] < move_scores[next_move]){
+                // swap scores
+                int temp_score = move_scores[current_move];
+                move_scores[current_move] = move_scores[next_move];
+                move_scores[next_move] = temp_score;
+
+                // swap moves
+                int temp_move = move_list->moves[current_move];
+                move_list->moves[current_move] = move_list->moves[next_move];
+                move_list->moves[next_move] = temp_move;
+            }
+        }
+    }
+}
+
+// delta pruning: skip captures that can't lift stand pat up to alpha even with this margin
+int delta_margin = 200;
+
+//quiesence search (fail-soft: returns the best score found, even outside the window)
+static inline int quiescence(int alpha, int beta) {
+    // every 2047 nodes
+    if ((nodes & 2047) == 0)
+        // "listen" to the GUI/user input
+        communicate();
+
+    // we are too deep, so there's an overflow of arrays
+    if (ply > max_ply - 1)
+        // evaluate position
+        return evaluate();
+
+    nodes++;
+
+    // in check there is no stand pat: every evasion is searched
+    int in_check = (get_attack_info()->checkers != 0);
+    int best_score = -infinity;
+
+    if (!in_check){
+        // stand pat
+        best_score = evaluate();
+        if (best_score >= beta){
+            // node (move) fails high
+            return best_score;
+        }
+
+        // found a better move
+        if (best_score > alpha){
+            // PV node (move)
+            alpha = best_score;
+        }
+    }
+
+    moves move_list[1];
+    generate_moves(move_list);
+
+    // captures only: drop the quiet moves before scoring and sorting them
+    if (!in_check){
+        int captures = 0;
+        for (int count = 0; count < move_list->count; count++)
+            if (get_move_capture(move_list->moves[count]))
+                move_list->moves[captures++] = move_list->moves[count];
+        move_list->count = captures;
+    }
+
+    sort_moves(move_list, 0);
+
+    int legal_moves = 0;
+
+    // loop over moves within a movelist
+    for (int count = 0; count < move_list->count; count++){
+        int move = move_list->moves[count];
+
+        if (!in_check && get_move_promoted(move) == 0){
+            // delta pruning: even winning the victim for free won't reach alpha
+            if (best_score + see_value[get_captured_piece(move)] + delta_margin <= alpha)
+                continue;
+
+            // SEE pruning: the exchange loses material
+            if (!see(move, 0))
+                continue;
+        }
+
+        copy_board();
+        ply++;
+        if (make_move(move, in_check ? all_moves : only_captures) == 0){
+            // decrement ply
+            ply--;
+            continue;
+        }
+
+        legal_moves++;
+
+        // score current move
+        int score = -quiescence(-beta, -alpha);
+        ply--;
+
+        take_back();
+
+        if (stopped == 1) return 0;
+
+        if (score > best_score){
+            best_score = score;
+
+            if (score >= beta){
+                // node (move) fails high
+                return score;
+            }
+
+            if (score > alpha){
+                // PV node (move)
+                alpha = score;
+            }
+        }
+    }
+
+    // checkmate
+    if (in_check && legal_moves == 0)
+        return -mate_value + ply;
+
+    // node (move) fails low
+    return best_score;
+}
+
+/*
+    Principal variation search, fail-soft.
+
+    PV nodes are searched with an open window and maintain the PV table;
+    every other move is first tried with a null window (alpha, alpha + 1)
+    as a non-PV node, which only has to prove the move is not better, and
+    is re-searched as a PV node if it turns out to be. Non-PV nodes never
+    touch the PV table and may be cut by TT bounds.
+*/
+enum { non_pv_node, pv_node };
+
+/*
+      ================================
+          Late move reductions
+      --------------------------------
+      reductions[depth][moves searched] =
+          base + ln(depth) * ln(moves) / divisor
+      (base and divisor in 1/100 ply), then per move:
+      - 1 less on PV nodes
+      - 1 more if the eval is not improving
+      - 1 less for killer moves
+      - quiet history / LMRHistory less (more if it is negative)
+      ================================
+*/
+const int full_depth_moves = 2;
+const int reduction_limit = 3;
+
+int lmr_base = 50;
+int lmr_divisor = 250;
+int lmr_history = 8192;
+
+int reductions[max_ply][256];
+
+// static eval of every ply on the current line, to tell if we are improving
+int static_evals[max_ply];
+
+// fill the reduction table from the LMR tunables
+void init_reductions(){
+    for (int depth = 0; depth < max_ply; depth++)
+        for (int count = 0; count < 256; count++)
+            reductions[depth][count] = (depth && count) ?
+                (int)(lmr_base / 100.0 + log((double)depth) * log((double)count) / (lmr_divisor / 100.0)) : 0;
+}
+
+/*
+      ================================
+         Shallow depth pruning
+      --------------------------------
+      Non-PV nodes only, never in check.
+      - reverse futility: eval - margin * depth >= beta -> fail high
+      - razoring: eval + margin * depth <= alpha -> trust qsearch
+      - futility: eval + base + margin * depth <= alpha -> skip quiets
+      - late move pruning: skip quiets after 3 + depth^2 moves (+ base)
+      ================================
+*/
+int rfp_depth = 6;
+int rfp_margin = 75;
+int razor_depth = 3;
+int razor_margin = 200;
+int futility_depth = 5;
+int futility_base = 60;
+int futility_margin = 90;
+int lmp_depth = 4;
+int lmp_base = 3;
+
+/*
+      ================================
+           Null move pruning
+      --------------------------------
+      Non-PV, not in check, eval >= beta and some non-pawn material
+      (pawn endings are where zugzwang lives).
+      R = base + depth / depth divisor + (eval - beta) / eval divisor
+      From NMPVerifyDepth on, a fail high is verified by a normal
+      search without null moves for the next plies.
+      ================================
+*/
+int nmp_base = 3;
+int nmp_depth_divisor = 4;
+int nmp_eval_divisor = 200;
+int nmp_verify_depth = 12;
+
+/*
+      ================================
+                ProbCut
+      --------------------------------
+      From ProbCutDepth on, at non-PV nodes, captures with
+      SEE >= beta + margin - eval are searched against the raised beta,
+      qsearch first and then at depth - 4. If one fails high the node
+      is cut and stored as a lower bound at depth - 3.
+      ================================
+*/
+int probcut_depth = 5;
+int probcut_margin = 200;
+
+/*
+      ================================
+          Singular extensions
+      --------------------------------
+      From SingularDepth on, a TT move with a deep enough lower bound
+      is tested by searching the other moves at (depth - 1) / 2 against
+      tt score - margin * depth:
+      - all of them fail low: the TT move is singular, extend it
+      - one of them beats beta too: multi-cut, several moves hold, cut
+      Check and singular extensions are only granted while ply is below
+      twice the root depth, so forcing lines can't grow the tree forever.
+      Off by default (SingularDepth 64): it hasn't gained in self-play
+      yet, set SingularDepth to 8 to try it.
+      ================================
+*/
+int singular_depth = 64;
+int singular_margin = 2;
+
+// internal iterative reduction: nodes from this depth on lose a ply when the TT has no move
+int iir_depth = 4;
+
+// move skipped by the singular search at each ply
+int excluded_moves[max_ply];
+
+// depth of the current iteration at the root, the extension budget is 2 * root_depth plies
+int root_depth;
+
+// no null moves before this ply (set while verifying a null move fail high)
+int nmp_min_ply = 0;
+
+// side to move has something besides pawns and king
+static inline int has_non_pawn_material(){
+    return (side == white) ? (bitboards[N] | bitboards[B] | bitboards[R] | bitboards[Q]) != 0
+                           : (bitboards[n] | bitboards[b] | bitboards[r] | bitboards[q]) != 0;
+}
+
+// search parameters exposed as UCI spin options for tuning
+typedef struct {
+    const char* name;
+    int* value;
+    int min;
+    int max;
+} tunable;
+
+tunable tunables[] = {
+    { "RFPDepth",       &rfp_depth,         0,  16    },
+    { "RFPMargin",      &rfp_margin,        0,  1000  },
+    { "RazorDepth",     &razor_depth,       0,  8     },
+    { "RazorMargin",    &razor_margin,      0,  2000  },
+    { "FutilityDepth",  &futility_depth,    0,  16    },
+    { "FutilityBase",   &futility_base,     0,  1000  },
+    { "FutilityMargin", &futility_margin,   0,  1000  },
+    { "LMPDepth",       &lmp_depth,         0,  16    },
+    { "LMPBase",        &lmp_base,          0,  64    },
+    { "NMPBase",        &nmp_base,          1,  8     },
+    { "NMPDepthDiv",    &nmp_depth_divisor, 1,  16    },
+    { "NMPEvalDiv",     &nmp_eval_divisor,  1,  2000  },
+    { "NMPVerifyDepth", &nmp_verify_depth,  1,  64    },
+    { "ProbCutDepth",   &probcut_depth,     1,  64    },
+    { "ProbCutMargin",  &probcut_margin,    0,  2000  },
+    { "SingularDepth",  &singular_depth,    1,  64    },
+    { "SingularMargin", &singular_margin,   0,  64    },
+    { "IIRDepth",       &iir_depth,         1,  64    },
+    { "DeltaMargin",    &delta_margin,      0,  2000  },
+    { "LMRBase",        &lmr_base,          0,  300   },
+    { "LMRDivisor",     &lmr_divisor,       50, 1000  },
+    { "LMRHistory",     &lmr_history,       1,  65536 },
+};
+
+// print the tunables as UCI options
+void print_tunables(){
+    for (int index = 0; index < (int)(sizeof(tunables) / sizeof(tunables[0])); index++)
+        std::cout << "option name " << tunables[index].name << " type spin default " << *tunables[index].value
+                  << " min " << tunables[index].min << " max " << tunables[index].max << "\n";
+}
+
+// set a tunable from "setoption name <name> value <value>", 1 if the name matched
+int set_tunable(const char* name, const char* value){
+    for (int index = 0; index < (int)(sizeof(tunables) / sizeof(tunables[0])); index++){
+        size_t length = strlen(tunables[index].name);
+
+        // exact name (setoption leaves trailing spaces/newline)
+        if (strncmp(name, tunables[index].name, length) == 0 && (name[length] == '\0' || isspace((unsigned char)name[length]))){
+            if (value) *tunables[index].value = std::max(tunables[index].min, std::min(atoi(value), tunables[index].max));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+static inline int negamax(int alpha, int beta, int depth, int node_type){
+    // every 2047 nodes
+    if ((nodes & 2047) == 0)
+        // "listen" to the GUI/user input
+        communicate();
+
+    // we are too deep, so there's an overflow of arrays
+    if (ply > max_ply - 1)
+        // evaluate position
+        return evaluate();
+
+    int is_pv = (node_type == pv_node);
+
+    // init PV length
+    pv_length[ply] = ply;
+
+    if (ply == 0) root_depth = depth;
+
+    if (ply){
+        // draw by repetition, fifty move rule or material neither side can win with (four pieces at most)
+        if (is_repetition() || fifty >= 100 || (count_bits(occupancies[both]) <= 4 && probe_material_entry()->draw))
+            return 0;
+
+        // a reversible move gets back to a position of this line: the draw is already available
+        if (alpha < 0 && has_upcoming_repetition()){
+            alpha = 0;
+            if (alpha >= beta) return alpha;
+        }
+
+        // endgame bitbases: a draw is exact, a won or lost position is searched on so the mate is found
+        // (the evaluation drives the conversion), the result only cuts windows it settles on its own
+        if (count_bits(occupancies[both]) <= bitbase_max_pieces){
+            int result = probe_bitbase();
+            if (result == bitbase_draw) return 0;
+            if (result == bitbase_win && beta <= 0) return beta;
+            if (result == bitbase_loss && alpha >= 0) return alpha;
+        }
+    }
+
+    // singular search: same position without the TT move
+    int excluded_move = excluded_moves[ply];
+
+    if (depth == 0)
+        // return evaluation
+        return quiescence(alpha, beta);
+
+    nodes++;
+
+    // probe the transposition table: a move to try first and, off the PV, maybe a cutoff
+    int tt_move = 0, tt_depth = -1, tt_flag = hash_flag_alpha, tt_score = 0;
+    tt* entry = excluded_move ? NULL : probe_hash_entry();
+    if (entry){
+        // copy it, deeper searches may overwrite the slot
+        tt_move = entry->best_move;
+        tt_depth = entry->depth;
+        tt_flag = entry->flag;
+        tt_score = score_from_tt(entry->score, ply);
+
+        if (!is_pv && ply && tt_depth >= depth){
+            if (tt_flag == hash_flag_exact ||
+               (tt_flag == hash_flag_beta && tt_score >= beta) ||
+               (tt_flag == hash_flag_alpha && tt_score <= alpha))
+                return tt_score;
+        }
+    }
+
+    //is king in check
+    int in_check = (get_attack_info()->checkers != 0);
+
+    // increase depth if in check because you can get mated, within the extension budget
+    int can_extend = ply < 2 * root_depth;
+    if (in_check && can_extend) depth++;
+
+    // internal iterative reduction: without a TT move the ordering is poor, search shallower
+    if (depth >= iir_depth && !tt_move && !excluded_move)
+        depth--;
+
+    int legal_moves = 0;
+
+    // static evaluation for the pruning and reduction decisions below (meaningless in check)
+    int static_eval = in_check ? -infinity : evaluate();
+    static_evals[ply] = static_eval;
+
+    // better than two plies ago, when we had the move last time
+    int improving = !in_check && ply >= 2 && static_eval > static_evals[ply - 2];
+
+    if (!is_pv && !in_check && ply && !excluded_move){
+        // reverse futility pruning: so far above beta that a quiet move won't bring it back
+        if (depth <= rfp_depth && beta < mate_score && static_eval - rfp_margin * depth >= beta)
+            return static_eval;
+
+        // razoring: hopelessly below alpha, only a tactic can help and qsearch will find it
+        if (depth <= razor_depth && static_eval + razor_margin * depth <= alpha){
+            int score = quiescence(alpha, alpha + 1);
+            if (score <= alpha) return score;
+        }
+    }
+
+    // null move pruning
+    if (!is_pv && depth >= 3 && in_check == 0 && ply && ply >= nmp_min_ply && !excluded_move &&
+        static_eval >= beta && has_non_pawn_material()){
+        // adaptive reduction: deeper and further above beta -> bigger R
+        int reduction = nmp_base + depth / nmp_depth_divisor + std::min((static_eval - beta) / nmp_eval_divisor, 3);
+
+        copy_board();
+
+        ply++;
+        move_stack[ply] = 0;
+
+        // switch the side, giving opponent an extra move to make
+        side ^= 1;
+        hash_key ^= side_key;
+
+        // reset enpassant capture square
+        if (enpassant != no_sq) hash_key ^= enpassant_keys[enpassant];
+        enpassant = no_sq;
+
+        // repetitions can't be counted across a null move
+        fifty = 0;
+        if (repetition_index < max_history - 1) repetition_table[++repetition_index] = hash_key;
+
+        /* search moves with reduced depth to find beta cutoffs
+           depth - 1 - R where R is a reduction limit */
+        int score = -negamax(-beta, -beta + 1, std::max(0, depth - 1 - reduction), non_pv_node);
+
+        ply--;
+
+        take_back();
+
+        if (stopped == 1) return 0;
+
+        // beta cutoff (an unproven mate from a null move is just "good enough")
+        if (score >= beta){
+            if (score >= mate_score) score = beta;
+
+            // shallow: trust it
+            if (depth < nmp_verify_depth || nmp_min_ply)
+                // node (move) fails high
+                return score;
+
+            // deep: verify with a real reduced search, no null moves for the next plies
+            nmp_min_ply = ply + 3 * (depth - reduction) / 4;
+            int verified = negamax(beta - 1, beta, depth - reduction, non_pv_node);
+            nmp_min_ply = 0;
+
+            if (stopped == 1) return 0;
+
+            if (verified >= beta)
+                return score;
+        }
+    }
+
+    moves move_list[1];
+    generate_moves(move_list);
+
+    // if we are now following PV line
+    if (follow_pv)
+        // enable PV move scoring
+        enable_pv_scoring(move_list);
+
+
+    sort_moves(move_list, tt_move);
+
+    // ProbCut: a good capture that beats beta by a margin at reduced depth will beat beta at full depth
+    int probcut_beta = beta + probcut_margin;
+    if (!is_pv && !in_check && depth >= probcut_depth && abs(beta) < mate_score && !excluded_move &&
+        // the TT already knows this node stays below the raised beta
+        !(tt_depth >= depth - 3 && tt_flag != hash_flag_beta && tt_score < probcut_beta)){
+        for (int count = 0; count < move_list->count; count++){
+            int move = move_list->moves[count];
+
+            // captures that win at least what we are missing
+            if (get_move_capture(move) == 0 || !see(move, probcut_beta - static_eval))
+                continue;
+
+            copy_board();
+            ply++;
+            move_stack[ply] = move;
+
+            if (make_move(move, all_moves) == 0){
+                ply--;
+                continue;
+            }
+
+            // cheap qsearch first, then confirm with a reduced search
+            int score = -quiescence(-probcut_beta, -probcut_beta + 1);
+            if (score >= probcut_beta)
+                score = -negamax(-probcut_beta, -probcut_beta + 1, depth - 4, non_pv_node);
+
+            ply--;
+            take_back();
+
+            if (stopped == 1) return 0;
+
+            if (score >= probcut_beta){
+                write_hash_entry(score, move, depth - 3, hash_flag_beta, ply);
+                return score;
+            }
+        }
+    }
+
+    // singular extension / multi-cut for the TT move
+    int singular_extension = 0;
+    if (ply && depth >= singular_depth && tt_move && !excluded_move && can_extend &&
+        tt_depth >= depth - 3 && tt_flag != hash_flag_alpha && abs(tt_score) < mate_score){
+        int singular_beta = tt_score - singular_margin * depth;
+
+        excluded_moves[ply] = tt_move;
+        int score = negamax(singular_beta - 1, singular_beta, (depth - 1) / 2, non_pv_node);
+        excluded_moves[ply] = 0;
+
+        if (stopped == 1) return 0;
+
+        // nothing else comes close: the TT move deserves a deeper look
+        if (score < singular_beta)
+            singular_extension = 1;
+
+        // another move beats beta as well, it's very likely to hold
+        else if (singular_beta >= beta)
+            return singular_beta;
+    }
+
+    // number of moves searched in a move list
+    int moves_searched = 0;
+
+    // fail-soft: best score and move, and the flag the TT entry will get
+    int best_score = -infinity;
+    int best_move = 0;
+    int hash_flag = hash_flag_alpha;
+
+    // moves searched without a cutoff, they get a history malus if a later move cuts
+    int quiets_tried[64], quiet_count = 0;
+    int captures_tried[32], capture_count = 0;
+
+    // loop over moves within a movelist
+    for (int count = 0; count < move_list->count; count++){
+        // MultiPV: skip root moves of the lines already found in this iteration
+        if (ply == 0 && is_root_excluded(move_list->moves[count]))
+            continue;
+
+        // singular search: skip the TT move
+        if (move_list->moves[count] == excluded_move)
+            continue;
+
+        // prune late quiet moves once a move has been searched and we're not getting mated
+        if (!is_pv && !in_check && moves_searched && best_score > -mate_score &&
+            get_move_capture(move_list->moves[count]) == 0 && get_move_promoted(move_list->moves[count]) == 0){
+            // late move pruning: enough quiets tried, the rest are sorted below them
+            if (depth <= lmp_depth && moves_searched >= lmp_base + depth * depth)
+                continue;
+
+            // futility pruning: a quiet move won't lift this eval up to alpha
+            if (depth <= futility_depth && static_eval + futility_base + futility_margin * depth <= alpha)
+                continue;
+        }
+
+        int quiet = (get_move_capture(move_list->moves[count]) == 0);
+        int move_history = quiet ? quiet_history(move_list->moves[count]) : 0;
+
+        // preserve board state
+        copy_board();
+
+        ply++;
+        move_stack[ply] = move_list->moves[count];
+
+        // make sure to make only legal moves
+        if (make_move(move_list->moves[count], all_moves) == 0){
+            // decrement ply
+            ply--;
+            continue;
+        }
+
+        legal_moves++;
+
+        // depth left for this move
+        int new_depth = depth - 1 + ((move_list->moves[count] == tt_move) ? singular_extension : 0);
+
+        int score;
+        // first move: full window, a PV node's first child is a PV node too
+        if (moves_searched == 0)
+            // do normal alpha beta search
+            score = -negamax(-beta, -alpha, new_depth, node_type);
+
+        // late move reduction (LMR) and null window searches
+        else{
+            int full_depth_search = 1;
+
+            // condition to consider LMR
+            if (
+                moves_searched >= full_depth_moves &&
+                depth >= reduction_limit &&
+                in_check == 0 &&
+                get_move_capture(move_list->moves[count]) == 0 &&
+                get_move_promoted(move_list->moves[count]) == 0
+                ){
+                int reduction = reductions[std::min(depth, max_ply - 1)][std::min(moves_searched, 255)];
+
+                reduction -= is_pv;
+                reduction += !improving;
+
+                // killers of this ply (ply was already incremented for the child)
+                if (move_list->moves[count] == killer_moves[0][ply - 1] || move_list->moves[count] == killer_moves[1][ply - 1])
+                    reduction--;
+
+                reduction -= move_history / lmr_history;
+
+                // drop straight into qsearch at most, never extend
+                reduction = std::max(0, std::min(reduction, new_depth));
+
+                if (reduction){
+                    // search current move with reduced depth:
+                    score = -negamax(-alpha - 1, -alpha, new_depth - reduction, non_pv_node);
+
+                    // re-search at full depth only if the reduced search beat alpha
+                    full_depth_search = (score > alpha);
+                }
+            }
+
+            if (full_depth_search)
+                /* Once you've found a move with a score that is between alpha and beta,
+                the rest of the moves are searched with the goal of proving that they are all bad.
+                It's possible to do this a bit faster than a search that worries that one
+                of the remaining moves might be good. */
+                score = -negamax(-alpha - 1, -alpha, new_depth, non_pv_node);
+
+            /* If the algorithm finds out that it was wrong, and that one of the
+            subsequent moves was better than the first PV move, it has to search again,
+            in the normal alpha-beta manner.  This happens sometimes, and it's a waste of time,
+            but generally not often enough to counteract the savings gained from doing the
+            "bad move proof" search referred to earlier. */
+            if (is_pv && (score > alpha) && (score < beta))
+                score = -negamax(-beta, -alpha, new_depth, pv_node);
+        }
+        
+
+        ply--;
+
+        take_back();
+
+        if (stopped == 1) return 0;
+
+        // increment the counter of moves searched so far
+        moves_searched++;
+
+        if (score > best_score){
+            best_score = score;
+
+            // found a better move
+            if (score > alpha){
+                best_move = move_list->moves[count];
+
+                // PV bookkeeping on PV nodes only
+                if (is_pv){
+                    // write PV move
+                    pv_table[ply][ply] = move_list->moves[count];
+
+                    // loop over the next ply
+                    for (int next_ply = ply + 1; next_ply < pv_length[ply + 1]; next_ply++)
+                        // copy move from deeper ply into a current ply's line
+                        pv_table[ply][next_ply] = pv_table[ply + 1][next_ply];
+
+                    // adjust PV length
+                    pv_length[ply] = pv_length[ply + 1];
+                }
+
+                // beta cutoff
+                if (score >= beta){
+                    int bonus = history_bonus(depth);
+
+                    // on quiet moves
+                    if (quiet){
+                        // store killer moves
+                        killer_moves[1][ply] = killer_moves[0][ply];
+                        killer_moves[0][ply] = move_list->moves[count];
+
+                        // store counter move
+                        if (move_stack[ply])
+                            counter_moves[get_move_piece(move_stack[ply])][get_move_target(move_stack[ply])] = move_list->moves[count];
+
+                        // reward the move, punish the quiets tried before it
+                        update_quiet_history(move_list->moves[count], bonus);
+                        for (int index = 0; index < quiet_count; index++)
+                            update_quiet_history(quiets_tried[index], -bonus);
+                    }
+
+                    else update_history(capture_history_entry(move_list->moves[count]), bonus);
+
+                    // captures tried before failed to cut either way
+                    for (int index = 0; index < capture_count; index++)
+                        update_history(capture_history_entry(captures_tried[index]), -bonus);
+
+                    hash_flag = hash_flag_beta;
+
+                    // node (move) fails high
+                    break;
+                }
+
+                // PV node (move)
+                alpha = score;
+                hash_flag = hash_flag_exact;
+            }
+        }
+
+        if (quiet && quiet_count < 64) quiets_tried[quiet_count++] = move_list->moves[count];
+        else if (!quiet && capture_count < 32) captures_tried[capture_count++] = move_list->moves[count];
+    }
+
+    // no legal move in current position
+    if (legal_moves == 0){
+        // singular search: the TT move was the only one
+        if (excluded_move)
+            return alpha;
+
+        // king is in check
+        if (in_check)
+            // return mating score (assuming closest distance to mating position)
+            return -mate_value + ply;
+
+        //king is not in check
+        else
+            // return stalemate score
+            return 0;
+    }
+
+    // store the result, unless some moves were excluded (MultiPV at the root, singular search)
+    if ((ply || root_excluded_count == 0) && !excluded_move)
+        write_hash_entry(best_score, best_move, depth, hash_flag, ply);
+
+    // fail-soft: best score, possibly outside the window
+    return best_score;
+}
+
+// print score in UCI format: "cp x" or "mate n" (n in moves, negative if we're getting mated)
+void print_score(int score) {
+    if (score > -mate_value && score < -mate_score)
+        std::cout << "mate " << -(score + mate_value) / 2;
+    else if (score > mate_score && score < mate_value)
+        std::cout << "mate " << (mate_value - score) / 2 + 1;
+    else
+        std::cout << "cp " << score;
+}
+
+/*
+      ================================
+            Aspiration windows
+      --------------------------------
+      Each line is searched with a window of +/- delta around its previous
+      score. On a fail the same depth is searched again with the failing
+      side moved out by a delta that grows 1.5x per attempt; past
+      aspiration_max_delta that side goes to infinity.
+      ================================
+*/
+// no windows below this depth (scores still jump around)
+const int aspiration_min_depth = 4;
+// initial half-window before volatility
+const int aspiration_base_delta = 12;
+// beyond this the failing side is opened completely
+const int aspiration_max_delta = 800;
+
+// per-depth cost of aspiration failures, printed by the "aspstats" command
+typedef struct {
+    long long searches;
+    long long fail_highs;
+    long long fail_lows;
+    long long fail_high_nodes;
+    long long fail_low_nodes;
+} aspiration_stat;
+
+aspiration_stat aspiration_stats[max_ply + 1];
+
+// initial half-window for a line: shallower iterations and volatile lines get more room
+static inline int aspiration_delta(int depth, int volatility){
+    return aspiration_base_delta + volatility + 32 / depth;
+}
+
+// print the bound of a failed aspiration search (UCI "lowerbound"/"upperbound")
+void print_bound(int depth, int index, int score, const char* bound){
+    std::cout << "info depth " << depth << " multipv " << index + 1 << " score ";
+    print_score(score);
+    std::cout << " " << bound << " nodes " << nodes << " time " << get_time_ms() - starttime << "\n";
+}
+
+// dump aspiration statistics per depth
+void print_aspiration_stats(){
+    std::cout << "\n depth  searches  fail-high  fail-low  fail-high nodes  fail-low nodes\n";
+    for (int depth = 1; depth <= max_ply; depth++){
+        aspiration_stat* stat = &aspiration_stats[depth];
+        if (!stat->searches) continue;
+        printf(" %5d  %8lld  %9lld  %8lld  %15lld  %14lld\n", depth, stat->searches,
+            stat->fail_highs, stat->fail_lows, stat->fail_high_nodes, stat->fail_low_nodes);
+    }
+    std::cout << std::endl;
+}
+
+// print one PV line as UCI info
+void print_pv_line(int depth, int index, pv_line* line){
+    std::cout << "info depth " << depth << " multipv " << index + 1 << " score ";
+    print_score(line->score);
+    std::cout << " nodes " << nodes << " time " << get_time_ms() - starttime << " pv ";
+    // loop over the moves within a PV line
+    for (int count = 0; count < line->length; count++) {
+        // print PV move
+        print_move(line->moves[count]);
+        std::cout << " ";
+    }
+    std::cout << "\n";
+}
+
+// count legal moves in the current position
+int count_legal_moves(){
+    moves move_list[1];
+    generate_moves(move_list);
+
+    int legal_moves = 0;
+    for (int count = 0; count < move_list->count; count++){
+        copy_board();
+        if (make_move(move_list->moves[count], all_moves)){
+            legal_moves++;
+            take_back();
+        }
+    }
+
+    return legal_moves;
+}
+
+// search position for the best move
+void search_position(int depth){
+    nodes = 0;
+    // reset follow PV flags
+    follow_pv = 0;
+    score_pv = 0;
+
+    // clear helper data structures for search (the history tables are kept for the whole game)
+    memset(killer_moves, 0, sizeof(killer_moves));
+    memset(pv_table, 0, sizeof(pv_table));
+    memset(pv_length, 0, sizeof(pv_length));
+    memset(pv_lines, 0, sizeof(pv_lines));
+
+    // can't report more lines than there are legal root moves
+    int lines = std::min(multi_pv, count_legal_moves());
+    lines = std::max(lines, 1);
+
+    // time manager state: iterations the best move survived, last score and iteration times
+    int best_move = 0, best_move_stability = 0, previous_score = 0;
+    long long iteration_start = starttime, last_iteration_time = 0;
+
+    // iterative deepening
+    for (int current_depth = 1; current_depth <= depth; current_depth++){
+
+        if (stopped == 1) break;
+
+        // one pass per line, each excluding the root moves of the better lines
+        root_excluded_count = 0;
+        int pv_index;
+        for (pv_index = 0; pv_index < lines; pv_index++){
+            pv_line* line = &pv_lines[pv_index];
+
+            // follow this line's PV from the previous iteration
+            memcpy(pv_table[0], line->moves, sizeof(line->moves));
+            pv_length[0] = line->length;
+
+            // per-line aspiration window around the line's previous score,
+            // wider for volatile lines, full width while the scores are still shallow noise
+            int delta = aspiration_delta(current_depth, line->volatility);
+            int alpha = (current_depth >= aspiration_min_depth) ? std::max(line->score - delta, -infinity) : -infinity;
+            int beta = (current_depth >= aspiration_min_depth) ? std::min(line->score + delta, infinity) : infinity;
+            int score;
+
+            aspiration_stats[current_depth].searches++;
+
+            // re-search the same depth until the score lands inside the window
+            while (1){
+                long long nodes_before = nodes;
+
+                follow_pv = 1;
+
+                // find best move within a given position
+                score = negamax(alpha, beta, current_depth, pv_node);
+
+                if (stopped == 1) break;
+
+                // fail low: widen the window downwards only
+                if (score <= alpha){
+                    aspiration_stats[current_depth].fail_lows++;
+                    aspiration_stats[current_depth].fail_low_nodes += nodes - nodes_before;
+                    print_bound(current_depth, pv_index, score, "upperbound");
+                    alpha = (delta > aspiration_max_delta) ? -infinity : std::max(score - delta, -infinity);
+                }
+
+                // fail high: widen the window upwards only
+                else if (score >= beta){
+                    aspiration_stats[current_depth].fail_highs++;
+                    aspiration_stats[current_depth].fail_high_nodes += nodes - nodes_before;
+                    print_bound(current_depth, pv_index, score, "lowerbound");
+                    beta = (delta > aspiration_max_delta) ? infinity : std::min(score + delta, infinity);
+                }
+
+                // exact score
+                else break;
+
+                // exponential widening: 1.5x per failed search
+                delta += delta / 2;
+            }
+
+            // time is up: the pass is incomplete, don't report it (root moves that
+            // completed and raised alpha are already in the PV table)
+            if (stopped == 1) {
+                if (pv_index == 0 && pv_length[0] > 0) {
+                    memcpy(line->moves, pv_table[0], sizeof(line->moves));
+                    line->length = pv_length[0];
+                }
+                break;
+            }
+
+            // running average of how much this line's score moves between iterations
+            if (current_depth > 1)
+                line->volatility = (line->volatility * 3 + std::abs(score - line->score)) / 4;
+
+            line->score = score;
+            memcpy(line->moves, pv_table[0], sizeof(line->moves));
+            line->length = pv_length[0];
+
+            // the next line must not start with this move
+            root_excluded[root_excluded_count++] = line->moves[0];
+        }
+
+        // sort the finished lines by score (insertion sort, search instability can swap them)
+        for (int index = 1; index < pv_index; index++){
+            pv_line current = pv_lines[index];
+            int previous = index - 1;
+            while (previous >= 0 && pv_lines[previous].score < current.score){
+                pv_lines[previous + 1] = pv_lines[previous];
+                previous--;
+            }
+            pv_lines[previous + 1] = current;
+        }
+
+        // report only iterations where every line completed
+        if (stopped == 1) break;
+
+        for (int index = 0; index < lines; index++)
+            print_pv_line(current_depth, index, &pv_lines[index]);
+
+        int score = pv_lines[0].score;
+
+        // UCI "go mate": stop as soon as the requested mate is proven
+        if (mate_limit && score > mate_score && (mate_value - score) / 2 + 1 <= mate_limit)
+            break;
+
+        // track best move stability and score trend for the time manager
+        best_move_stability = (pv_lines[0].moves[0] == best_move) ? best_move_stability + 1 : 0;
+        int score_drop = (current_depth > 1) ? previous_score - score : 0;
+        best_move = pv_lines[0].moves[0];
+        previous_score = score;
+
+        if (timeset == 1){
+            long long now = get_time_ms();
+            long long elapsed = now - starttime;
+            long long iteration_time = now - iteration_start;
+
+            // next iteration will cost about this one times the branching factor seen so far
+            long long branching = 2;
+            if (last_iteration_time)
+                branching = std::min(std::max(iteration_time / std::max(last_iteration_time, 1LL), 2LL), 5LL);
+            last_iteration_time = iteration_time;
+            iteration_start = now;
+
+            // don't start an iteration that would be cut by the hard limit and thrown away
+            if (elapsed + iteration_time * branching > maximum_time) break;
+
+            // spent the (stability-scaled) optimum: more depth isn't worth the clock
+            if (elapsed > scaled_optimum_time(best_move_stability, score_drop)) break;
+        }
+    }
+
+    // don't leave root exclusions behind for other searches
+    root_excluded_count = 0;
+
+    // UCI forbids sending bestmove while pondering: hold it until "ponderhit" or "stop"
+    while (pondering && !stopped)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::cout << "bestmove ";
+    print_move(pv_lines[0].moves[0]);
+
+    // expected reply: the GUI will ask us to ponder on it
+    if (pv_lines[0].length > 1) {
+        std::cout << " ponder ";
+        print_move(pv_lines[0].moves[1]);
+    }
+    std::cout << std::endl;
+}
+
+/**********************************\
+ ==================================
+
+               Bench
+
+ ==================================
+\**********************************/
+
+// fixed position set: the node count at a fixed depth is the search's signature,
+// compare it before/after a change (same count = no functional change)
+char bench_positions[][100] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 ",
+    "rnbqkb1r/pp1p1pPp/8/2p1pP2/1P1P4/3P3P/P1P1P3/RNBQKBNR w KQkq e6 0 1 ",
+    "r2q1rk1/ppp2ppp/2n1bn2/2b1p3/3pP3/3P1NPP/PPP1NPB1/R1BQ1RK1 b - - 0 9 ",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10 ",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8 ",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1 ",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19 ",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 3 8 ",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1 ",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1 ",
+    "6k1/5ppp/8/8/8/8/1r3PPP/3R2K1 w - - 0 1 ",
+};
+
+// search every bench position to a fixed depth and report total nodes and speed
+void bench(int depth){
+    long long total_nodes = 0;
+    long long start = get_time_ms();
+
+    // bench is a fixed-depth, single-line search regardless of the current options
+    int saved_multi_pv = multi_pv;
+    multi_pv = 1;
+    timeset = 0;
+    nodes_limit = 0;
+    mate_limit = 0;
+    pondering = 0;
+
+    clear_pawn_hash_table();
+
+    int positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    for (int index = 0; index < positions; index++){
+        std::cout << "\nPosition " << index + 1 << "/" << positions << ": " << bench_positions[index] << "\n";
+        parse_fen(bench_positions[index]);
+        clear_hash_table();
+        clear_history();
+
+        stopped = 0;
+        starttime = get_time_ms();
+        search_position(depth);
+
+        total_nodes += nodes;
+    }
+
+    multi_pv = saved_multi_pv;
+
+    long long elapsed = std::max(get_time_ms() - start, 1LL);
+    std::cout << "\n===========================\n";
+    std::cout << "Total time (ms) : " << elapsed << "\n";
+    std::cout << "Nodes searched  : " << total_nodes << "\n";
+    std::cout << "Nodes/second    : " << total_nodes * 1000 / elapsed << "\n";
+    std::cout << "Pawn hash hits  : " << pawn_hash_hits * 100 / std::max(pawn_hash_probes, 1LL) << "%" << std::endl;
+}
+
+// Optional: simple self-play data generation (fixed ply outcome labels)
+// Writes NPZ-compatible .npz via a tiny text intermediary (user converts) or prints to stdout.
+// For now, we provide a helper to dump features and outcomes to a .npz-like CSV.
+static void dump_features_and_result(const char* path, const std::vector<std::vector<float>>& X, const std::vector<float>& Z) {
+    FILE* f = nullptr;
+    fopen_s(&f, path, "w");
+    if (!f) return;
+    // CSV: first line dims, then rows of features and last column is z
+    fprintf(f, "N,%zu\n", X.size());
+    for (size_t i = 0; i < X.size(); ++i) {
+        const auto& v = X[i];
+        for (size_t j = 0; j < v.size(); ++j) {
+            fprintf(f, j+1==v.size()?"%g": "%g,", v[j]);
+        }
+        fprintf(f, ",%g\n", Z[i]);
+    }
+    fclose(f);
+}
+
+/**********************************\
+ ==================================
+
+            Texel tuner
+
+ ==================================
+\**********************************/
+
+/*
+      ================================
+       Tuning the classical evaluation
+      --------------------------------
+      "tune <file> [epochs] [threads]" fits the evaluation tables to
+      game results by minimizing (result - sigmoid(K * eval))^2.
+      Each position is traced once into the tuned values its eval
+      uses and how often (white's count minus black's). With those
+      counts the eval is a plain sum, so gradient descent works on
+      the traces alone, split over threads, and never touches the
+      board. Positions in check, not quiet (quiescence differs from
+      the static eval) or in known endings are skipped. King safety
+      is not linear in its weights and stays fixed.
+      One position per line: a FEN followed by white's result,
+      [1.0] / [0.5] / [0.0] or 1-0 / 1/2-1/2 / 0-1.
+      ================================
+*/
+
+// how a tuned value enters the eval
+enum { mg_term, eg_term, both_term, packed_term };
+
+typedef struct {
+    const char* name;       // table name in the source
+    const int* values;      // current values
+    int size;               // tuned entries
+    int kind;               // middle game, end game, both, or packed (a middle and an end game value per entry)
+} tune_table;
+
+enum {
+    tune_material, tune_pawn, tune_pawn_endgame, tune_knight, tune_bishop, tune_rook,
+    tune_king_middlegame, tune_king, tune_doubled, tune_isolated, tune_backward,
+    tune_passed, tune_passed_king, tune_mobility, tune_table_count
+};
+
+const tune_table tune_tables[tune_table_count] = {
+    { "material_score",          material_score,           5,  both_term   },
+    { "pawn_score",              pawn_score,               64, mg_term     },
+    { "pawn_endgame_score",      pawn_endgame_score,       64, eg_term     },
+    { "knight_score",            knight_score,             64, both_term   },
+    { "bishop_score",            bishop_score,             64, both_term   },
+    { "rook_score",              rook_score,               64, both_term   },
+    { "king_middlegame_score",   king_middlegame_score,    64, mg_term     },
+    { "king_score",              king_score,               64, eg_term     },
+    { "doubled_pawn_penalty",    &doubled_pawn_penalty,    1,  packed_term },
+    { "isolated_pawn_penalty",   &isolated_pawn_penalty,   1,  packed_term },
+    { "backward_pawn_penalty",   &backward_pawn_penalty,   1,  packed_term },
+    { "passed_pawn_bonus",       passed_pawn_bonus,        8,  packed_term },
+    { "passed_pawn_king_weight", passed_pawn_king_weight,  8,  eg_term     },
+    { "mobility_bonus",          mobility_bonus,           6,  packed_term },
+};
+
+// first tuned value of each table
+int tune_offset[tune_table_count];
+int tune_param_count;
+
+// tuned values and whether they are middle game, end game or both
+std::vector<double> tune_params;
+std::vector<char> tune_param_kind;
+
+// a tuned value used by a position
+typedef struct {
+    unsigned short index;   // into tune_params
+    short count;            // white's uses minus black's
+} tune_term;
+
+typedef struct {
+    int first_term;         // into tune_terms
+    int term_count;
+    int phase;              // max_phase with all pieces on the board, 0 with pawns and kings only
+    int fixed_score;        // untuned middle game terms (king safety), white's point of view
+    float result;           // 1 white won, 0.5 draw, 0 black won
+} tune_position;
+
+std::vector<tune_term> tune_terms;
+std::vector<tune_position> tune_positions;
+
+// lay out the tuned values and read their current settings
+void init_tune_params(){
+    tune_param_count = 0;
+    tune_params.clear();
+    tune_param_kind.clear();
+
+    for (int table = 0; table < tune_table_count; table++){
+        const tune_table* t = &tune_tables[table];
+        tune_offset[table] = tune_param_count;
+
+        for (int entry = 0; entry < t->size; entry++){
+            if (t->kind == packed_term){
+                tune_params.push_back(mg_score(t->values[entry]));
+                tune_params.push_back(eg_score(t->values[entry]));
+                tune_param_kind.push_back(mg_term);
+                tune_param_kind.push_back(eg_term);
+                tune_param_count += 2;
+            }
+            else {
+                tune_params.push_back(t->values[entry]);
+                tune_param_kind.push_back(t->kind);
+                tune_param_count++;
+            }
+        }
+    }
+}
+
+// count a use of a table entry (both halves of a packed one)
+static inline void trace_add(int* counts, int table, int entry, int count){
+    if (tune_tables[table].kind == packed_term){
+        counts[tune_offset[table] + entry * 2] += count;
+        counts[tune_offset[table] + entry * 2 + 1] += count;
+    }
+    else counts[tune_offset[table] + entry] += count;
+}
+
+// the tuned values the current position's eval uses, following evaluate() term by term
+static void trace_position(int* counts, int* fixed_score){
+    pawn_entry* pawns = probe_pawn_entry();
+    attack_info* info = get_attack_info();
+
+    *fixed_score = 0;
+
+    for (int color = white; color <= black; color++){
+        int sign = (color == white) ? 1 : -1;
+        int enemy = color ^ 1;
+        int first_piece = (color == white) ? P : p;
+        int enemy_first_piece = (enemy == white) ? P : p;
+        U64 own_pawns = bitboards[first_piece + P];
+        U64 enemy_pawns = bitboards[enemy_first_piece + P];
+
+        // material, piece square tables and pawn structure
+        for (int type = P; type <= K; type++){
+            U64 bitboard = bitboards[first_piece + type];
+
+            while (bitboard){
+                int square = get_ls1b_index(bitboard);
+                int table_square = (color == white) ? square : mirror_score[square];
+
+                switch (type){
+                    case P: trace_add(counts, tune_pawn, table_square, sign); trace_add(counts, tune_pawn_endgame, table_square, sign); break;
+                    case N: trace_add(counts, tune_knight, table_square, sign); break;
+                    case B: trace_add(counts, tune_bishop, table_square, sign); break;
+                    case R: trace_add(counts, tune_rook, table_square, sign); break;
+                    case K: trace_add(counts, tune_king_middlegame, table_square, sign); trace_add(counts, tune_king, table_square, sign); break;
+                }
+
+                if (type != K)
+                    trace_add(counts, tune_material, type, sign);
+
+                if (type == P){
+                    int row = square / 8;
+
+                    if (count_bits(own_pawns & file_masks[square]) > 1)
+                        trace_add(counts, tune_doubled, 0, sign);
+
+                    if ((own_pawns & isolated_masks[square]) == 0)
+                        trace_add(counts, tune_isolated, 0, sign);
+
+                    else if ((own_pawns & support_masks[color][square]) == 0){
+                        int stop_square = (color == white) ? square - 8 : square + 8;
+                        if (stop_square >= 0 && stop_square < 64 && (pawn_attacks[color][stop_square] & enemy_pawns))
+                            trace_add(counts, tune_backward, 0, sign);
+                    }
+
+                    if ((enemy_pawns & passed_masks[color][square]) == 0)
+                        trace_add(counts, tune_passed, (color == white) ? 7 - row : row, sign);
+                }
+
+                popSquare(bitboard, square);
+            }
+        }
+
+        // mobility
+        for (int type = N; type <= Q; type++)
+            trace_add(counts, tune_mobility, type, sign * info->mobility[first_piece + type]);
+
+        // king safety, not tuned
+        int king_square = get_ls1b_index(bitboards[first_piece + K]);
+        int danger = 0;
+        for (int type = P; type <= Q; type++)
+            danger += king_attack_weight[type] * info->king_zone_attacks[enemy_first_piece + type];
+        *fixed_score -= sign * std::min(danger * danger / 4, 300);
+
+        // passed pawns and the kings
+        int enemy_king_square = get_ls1b_index(bitboards[enemy_first_piece + K]);
+        U64 passed = pawns->passed_pawns[color];
+        while (passed){
+            int square = get_ls1b_index(passed);
+            int rank = (color == white) ? 7 - square / 8 : square / 8;
+            int stop_square = (color == white) ? square - 8 : square + 8;
+
+            trace_add(counts, tune_passed_king, rank,
+                      sign * (5 * square_distance(enemy_king_square, stop_square) - 2 * square_distance(king_square, stop_square)));
+
+            popSquare(passed, square);
+        }
+    }
+}
+
+// eval of a traced position from the tuned values, white's point of view
+static inline double tune_evaluate(const tune_position* position, const double* params){
+    double middlegame = position->fixed_score, endgame = 0;
+    const tune_term* term = &tune_terms[position->first_term];
+
+    for (int index = 0; index < position->term_count; index++, term++){
+        double value = params[term->index] * term->count;
+        int kind = tune_param_kind[term->index];
+
+        if (kind != eg_term) middlegame += value;
+        if (kind != mg_term) endgame += value;
+    }
+
+    return (middlegame * position->phase + endgame * (max_phase - position->phase)) / max_phase;
+}
+
+// game result expected from an eval
+static inline double tune_sigmoid(double k, double score){
+    return 1.0 / (1.0 + pow(10.0, -k * score / 400.0));
+}
+
+// split the positions over threads: each one runs work(first, last, thread index)
+template <typename F>
+static void tune_parallel(int threads, F work){
+    std::vector<std::thread> workers;
+    int count = (int)tune_positions.size();
+
+    for (int thread = 0; thread < threads; thread++)
+        workers.emplace_back(work, (int)((long long)count * thread / threads), (int)((long long)count * (thread + 1) / threads), thread);
+
+    for (auto& worker : workers) worker.join();
+}
+
+// mean squared error of the traced positions
+static double tune_error(double k, int threads){
+    std::vector<double> errors(threads, 0.0);
+    const double* params = tune_params.data();
+
+    tune_parallel(threads, [&](int first, int last, int thread){
+        double error = 0;
+        for (int index = first; index < last; index++){
+            const tune_position* position = &tune_positions[index];
+            double difference = position->result - tune_sigmoid(k, tune_evaluate(position, params));
+            error += difference * difference;
+        }
+        errors[thread] = error;
+    });
+
+    double error = 0;
+    for (double thread_error : errors) error += thread_error;
+    return error / std::max((int)tune_positions.size(), 1);
+}
+
+// scaling constant that best maps the current evals to the results
+static double tune_best_k(int threads){
+    double low = 0.0, high = 3.0;
+
+    // the error is unimodal in K: ternary search
+    for (int iteration = 0; iteration < 40; iteration++){
+        double k1 = low + (high - low) / 3, k2 = high - (high - low) / 3;
+        if (tune_error(k1, threads) < tune_error(k2, threads)) high = k2;
+        else low = k1;
+    }
+
+    return (low + high) / 2;
+}
+
+// read the labeled positions, keep the quiet ones and trace them
+static int load_tune_positions(const char* path){
+    FILE* file = nullptr;
+    fopen_s(&file, path, "r");
+    if (!file){
+        std::cout << "info string cannot open " << path << std::endl;
+        return 0;
+    }
+
+    std::vector<int> counts(tune_param_count);
+    char line[512];
+    long long lines = 0, mismatches = 0;
+
+    tune_terms.clear();
+    tune_positions.clear();
+
+    while (fgets(line, sizeof(line), file)){
+        tune_position position;
+        char* mark;
+
+        // result marker, the FEN ends there
+        lines++;
+        if ((mark = strchr(line, '[')) != nullptr) position.result = (float)atof(mark + 1);
+        else if ((mark = strstr(line, "1-0")) != nullptr) position.result = 1.0f;
+        else if ((mark = strstr(line, "0-1")) != nullptr) position.result = 0.0f;
+        else if ((mark = strstr(line, "1/2-1/2")) != nullptr) position.result = 0.5f;
+        else continue;
+        *mark = '\0';
+
+        parse_fen(line);
+
+        // only quiet positions: the static eval must be what the search would see
+        ply = 0;
+        if (get_attack_info()->checkers) continue;
+        int static_eval = evaluate();
+        if (quiescence(-infinity, infinity) != static_eval) continue;
+
+        // known endings aren't scored by the tables
+        material_entry* material = probe_material_entry();
+        if (material->draw || material->evaluate || material->scale_function[white] || material->scale_function[black] ||
+            material->scale[white] != scale_normal || material->scale[black] != scale_normal)
+            continue;
+
+        std::fill(counts.begin(), counts.end(), 0);
+        trace_position(counts.data(), &position.fixed_score);
+
+        position.phase = 0;
+        for (int piece = N; piece <= Q; piece++)
+            position.phase += phase_weight[piece] * count_bits(bitboards[piece] | bitboards[piece + p]);
+        position.phase = std::min(position.phase, max_phase);
+
+        position.first_term = (int)tune_terms.size();
+        for (int index = 0; index < tune_param_count; index++){
+            if (counts[index]){
+                tune_term term = { (unsigned short)index, (short)counts[index] };
+                tune_terms.push_back(term);
+            }
+        }
+        position.term_count = (int)tune_terms.size() - position.first_term;
+
+        // the trace must give back evaluate()'s score (up to its integer rounding)
+        double white_eval = (side == white) ? static_eval : -static_eval;
+        if (fabs(tune_evaluate(&position, tune_params.data()) - white_eval) > 1.0)
+            mismatches++;
+
+        tune_positions.push_back(position);
+    }
+
+    fclose(file);
+
+    std::cout << "Lines read      : " << lines << "\n";
+    std::cout << "Quiet positions : " << tune_positions.size() << "\n";
+    std::cout << "Trace mismatches: " << mismatches << std::endl;
+
+    return (int)tune_positions.size();
+}
+
+// print a tuned table as it is declared in the source
+static void print_tune_table(int table){
+    const tune_table* t = &tune_tables[table];
+    const double* values = &tune_params[tune_offset[table]];
+
+    if (table == tune_material){
+        printf("int material_score[12] = {\n   ");
+        for (int side_sign = 1; side_sign >= -1; side_sign -= 2){
+            for (int type = P; type <= Q; type++) printf(" %5d,", side_sign * (int)lround(values[type]));
+            printf(" %6d,%s", side_sign * 10000, side_sign == 1 ? "\n   " : "\n");
+        }
+        printf("};\n\n");
+    }
+    else if (t->kind == packed_term && t->size == 1)
+        printf("const int %s = make_score(%d, %d);\n\n", t->name, (int)lround(values[0]), (int)lround(values[1]));
+
+    else if (t->kind == packed_term){
+        printf("const int %s[%d] = {\n   ", t->name, t->size);
+        for (int entry = 0; entry < t->size; entry++)
+            printf(" make_score(%d, %d)%s", (int)lround(values[entry * 2]), (int)lround(values[entry * 2 + 1]),
+                   entry + 1 == t->size ? "\n" : ((entry + 1) % 4 == 0 ? ",\n   " : ","));
+        printf("};\n\n");
+    }
+    else if (t->size == 64){
+        printf("const int %s[64] ={\n", t->name);
+        for (int square = 0; square < 64; square++)
+            printf("%s%3d%s", square % 8 == 0 ? "   " : "", (int)lround(values[square]),
+                   square == 63 ? "\n" : (square % 8 == 7 ? ",\n" : ", "));
+        printf("};\n\n");
+    }
+    else {
+        printf("const int %s[%d] = {", t->name, t->size);
+        for (int entry = 0; entry < t->size; entry++)
+            printf(" %d%s", (int)lround(values[entry]), entry + 1 == t->size ? " " : ",");
+        printf("};\n\n");
+    }
+}
+
+// fit the evaluation tables to the labeled positions in a file and print them as source
+void tune(const char* path, int epochs, int threads){
+    // the classical eval is what gets tuned
+    bool nn_was_enabled = nn_is_enabled();
+    nn_set_enabled(false);
+
+    timeset = 0;
+    nodes_limit = 0;
+    stopped = 0;
+
+    init_tune_params();
+    clear_pawn_hash_table();
+
+    if (!load_tune_positions(path)){
+        nn_set_enabled(nn_was_enabled);
+        return;
+    }
+
+    double k = tune_best_k(threads);
+    std::cout << "K               : " << k << "\n";
+    std::cout << "Initial error   : " << tune_error(k, threads) << std::endl;
+
+    // Adam, one step per pass over all positions
+    const double learning_rate = 1.0, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    std::vector<double> momentum(tune_param_count, 0.0), velocity(tune_param_count, 0.0);
+    std::vector<std::vector<double>> gradients(threads, std::vector<double>(tune_param_count));
+    long long start = get_time_ms();
+
+    for (int epoch = 1; epoch <= epochs; epoch++){
+        const double* params = tune_params.data();
+
+        tune_parallel(threads, [&](int first, int last, int thread){
+            double* gradient = gradients[thread].data();
+            std::fill(gradient, gradient + tune_param_count, 0.0);
+
+            for (int index = first; index < last; index++){
+                const tune_position* position = &tune_positions[index];
+                double sigmoid = tune_sigmoid(k, tune_evaluate(position, params));
+
+                // d error / d eval, the constant factors are left to the learning rate
+                double slope = (sigmoid - position->result) * sigmoid * (1.0 - sigmoid);
+                double mg_slope = slope * position->phase / max_phase;
+                double eg_slope = slope - mg_slope;
+
+                const tune_term* term = &tune_terms[position->first_term];
+                for (int entry = 0; entry < position->term_count; entry++, term++){
+                    int kind = tune_param_kind[term->index];
+                    gradient[term->index] += term->count * (kind == mg_term ? mg_slope : (kind == eg_term ? eg_slope : slope));
+                }
+            }
+        });
+
+        for (int index = 0; index < tune_param_count; index++){
+            double gradient = 0;
+            for (int thread = 0; thread < threads; thread++) gradient += gradients[thread][index];
+
+            momentum[index] = beta1 * momentum[index] + (1 - beta1) * gradient;
+            velocity[index] = beta2 * velocity[index] + (1 - beta2) * gradient * gradient;
+
+            double corrected_momentum = momentum[index] / (1 - pow(beta1, epoch));
+            double corrected_velocity = velocity[index] / (1 - pow(beta2, epoch));
+            tune_params[index] -= learning_rate * corrected_momentum / (sqrt(corrected_velocity) + epsilon);
+        }
+
+        if (epoch % 50 == 0 || epoch == epochs){
+            long long elapsed = std::max(get_time_ms() - start, 1LL);
+            std::cout << "Epoch " << epoch << " error " << tune_error(k, threads)
+                      << " (" << (long long)tune_positions.size() * epoch * 1000 / elapsed << " evals/second)" << std::endl;
+        }
+    }
+
+    std::cout << "\n// tuned on " << tune_positions.size() << " positions from " << path << ", K = " << k << "\n\n";
+    for (int table = 0; table < tune_table_count; table++)
+        print_tune_table(table);
+    fflush(stdout);
+
+    // the tables were only printed, the engine's own are untouched
+    tune_terms.clear();
+    tune_terms.shrink_to_fit();
+    tune_positions.clear();
+    tune_positions.shrink_to_fit();
+    nn_set_enabled(nn_was_enabled);
+}
+
+//no iterative deepining in the server one need to modify gui
+int search_server_position(int depth) {
+    // find best move within a given position
+    int score = negamax(-infinity, infinity, depth, pv_node);
+
+    return pv_table[0][0];
+}
+
+/*
+      ================================
+              Opening book
+      --------------------------------
+      Polyglot .bin books: 16-byte big-endian entries (key, move,
+      weight, learn) sorted by key. The key is Polyglot's own hash
+      of the position, from its standard Random64 table, unrelated
+      to hash_key. The file is mapped read-only, so every engine
+      sharing a book reads the same cached pages, and a probe is a
+      binary search for the key and a weighted pick among its moves.
+      ================================
+*/
+
+// Random64: 768 piece keys (64 per piece, black pawn first), 4 castling, 8 en passant files, white to move
+const U64 polyglot_random[781] = {
+    0x9D39247E33776D41ULL, 0x2AF7398005AAA5C7ULL, 0x44DB015024623547ULL, 0x9C15F73E62A76AE2ULL,
+    0x75834465489C0C89ULL, 0x3290AC3A203001BFULL, 0x0FBBAD1F61042279ULL, 0xE83A908FF2FB60CAULL,
+    0x0D7E765D58755C10ULL, 0x1A083822CEAFE02DULL, 0x9605D5F0E25EC3B0ULL, 0xD021FF5CD13A2ED5ULL,
+    0x40BDF15D4A672E32ULL, 0x011355146FD56395ULL, 0x5DB4832046F3D9E5ULL, 0x239F8B2D7FF719CCULL,
+    0x05D1A1AE85B49AA1ULL, 0x679F848F6E8FC971ULL, 0x7449BBFF801FED0BULL, 0x7D11CDB1C3B7ADF0ULL,
+    0x82C7709E781EB7CCULL, 0xF3218F1C9510786CULL, 0x331478F3AF51BBE6ULL, 0x4BB38DE5E7219443ULL,
+    0xAA649C6EBCFD50FCULL, 0x8DBD98A352AFD40BULL, 0x87D2074B81D79217ULL, 0x19F3C751D3E92AE1ULL,
+    0xB4AB30F062B19ABFULL, 0x7B0500AC42047AC4ULL, 0xC9452CA81A09D85DULL, 0x24AA6C514DA27500ULL,
+    0x4C9F34427501B447ULL, 0x14A68FD73C910841ULL, 0xA71B9B83461CBD93ULL, 0x03488B95B0F1850FULL,
+    0x637B2B34FF93C040ULL, 0x09D1BC9A3DD90A94ULL, 0x3575668334A1DD3BULL, 0x735E2B97A4C45A23ULL,
+    0x18727070F1BD400BULL, 0x1FCBACD259BF02E7ULL, 0xD310A7C2CE9B6555ULL, 0xBF983FE0FE5D8244ULL,
+    0x9F74D14F7454A824ULL, 0x51EBDC4AB9BA3035ULL, 0x5C82C505DB9AB0FAULL, 0xFCF7FE8A3430B241ULL,
+    0x3253A729B9BA3DDEULL, 0x8C74C368081B3075ULL, 0xB9BC6C87167C33E7ULL, 0x7EF48F2B83024E20ULL,
+    0x11D505D4C351BD7FULL, 0x6568FCA92C76A243ULL, 0x4DE0B0F40F32A7B8ULL, 0x96D693460CC37E5DULL,
+    0x42E240CB63689F2FULL, 0x6D2BDCDAE2919661ULL, 0x42880B0236E4D951ULL, 0x5F0F4A5898171BB6ULL,
+    0x39F890F579F92F88ULL, 0x93C5B5F47356388BULL, 0x63DC359D8D231B78ULL, 0xEC16CA8AEA98AD76ULL,
+    0x5355F900C2A82DC7ULL, 0x07FB9F855A997142ULL, 0x5093417AA8A7ED5EULL, 0x7BCBC38DA25A7F3CULL,
+    0x19FC8A768CF4B6D4ULL, 0x637A7780DECFC0D9ULL, 0x8249A47AEE0E41F7ULL, 0x79AD695501E7D1E8ULL,
+    0x14ACBAF4777D5776ULL, 0xF145B6BECCDEA195ULL, 0xDABF2AC8201752FCULL, 0x24C3C94DF9C8D3F6ULL,
+    0xBB6E2924F03912EAULL, 0x0CE26C0B95C980D9ULL, 0xA49CD132BFBF7CC4ULL, 0xE99D662AF4243939ULL,
+    0x27E6AD7891165C3FULL, 0x8535F040B9744FF1ULL, 0x54B3F4FA5F40D873ULL, 0x72B12C32127FED2BULL,
+    0xEE954D3C7B411F47ULL, 0x9A85AC909A24EAA1ULL, 0x70AC4CD9F04F21F5ULL, 0xF9B89D3E99A075C2ULL,
+    0x87B3E2B2B5C907B1ULL, 0xA366E5B8C54F48B8ULL, 0xAE4A9346CC3F7CF2ULL, 0x1920C04D47267BBDULL,
+    0x87BF02C6B49E2AE9ULL, 0x092237AC237F3859ULL, 0xFF07F64EF8ED14D0ULL, 0x8DE8DCA9F03CC54EULL,
+    0x9C1633264DB49C89ULL, 0xB3F22C3D0B0B38EDULL, 0x390E5FB44D01144BULL, 0x5BFEA5B4712768E9ULL,
+    0x1E1032911FA78984ULL, 0x9A74ACB964E78CB3ULL, 0x4F80F7A035DAFB04ULL, 0x6304D09A0B3738C4ULL,
+    0x2171E64683023A08ULL, 0x5B9B63EB9CEFF80CULL, 0x506AACF489889342ULL, 0x1881AFC9A3A701D6ULL,
+    0x6503080440750644ULL, 0xDFD395339CDBF4A7ULL, 0xEF927DBCF00C20F2ULL, 0x7B32F7D1E03680ECULL,
+    0xB9FD7620E7316243ULL, 0x05A7E8A57DB91B77ULL, 0xB5889C6E15630A75ULL, 0x4A750A09CE9573F7ULL,
+    0xCF464CEC899A2F8AULL, 0xF538639CE705B824ULL, 0x3C79A0FF5580EF7FULL, 0xEDE6C87F8477609DULL,
+    0x799E81F05BC93F31ULL, 0x86536B8CF3428A8CULL, 0x97D7374C60087B73ULL, 0xA246637CFF328532ULL,
+    0x043FCAE60CC0EBA0ULL, 0x920E449535DD359EULL, 0x70EB093B15B290CCULL, 0x73A1921916591CBDULL,
+    0x56436C9FE1A1AA8DULL, 0xEFAC4B70633B8F81ULL, 0xBB215798D45DF7AFULL, 0x45F20042F24F1768ULL,
+    0x930F80F4E8EB7462ULL, 0xFF6712FFCFD75EA1ULL, 0xAE623FD67468AA70ULL, 0xDD2C5BC84BC8D8FCULL,
+    0x7EED120D54CF2DD9ULL, 0x22FE545401165F1CULL, 0xC91800E98FB99929ULL, 0x808BD68E6AC10365ULL,
+    0xDEC468145B7605F6ULL, 0x1BEDE3A3AEF53302ULL, 0x43539603D6C55602ULL, 0xAA969B5C691CCB7AULL,
+    0xA87832D392EFEE56ULL, 0x65942C7B3C7E11AEULL, 0xDED2D633CAD004F6ULL, 0x21F08570F420E565ULL,
+    0xB415938D7DA94E3CULL, 0x91B859E59ECB6350ULL, 0x10CFF333E0ED804AULL, 0x28AED140BE0BB7DDULL,
+    0xC5CC1D89724FA456ULL, 0x5648F680F11A2741ULL, 0x2D255069F0B7DAB3ULL, 0x9BC5A38EF729ABD4ULL,
+    0xEF2F054308F6A2BCULL, 0xAF2042F5CC5C2858ULL, 0x480412BAB7F5BE2AULL, 0xAEF3AF4A563DFE43ULL,
+    0x19AFE59AE451497FULL, 0x52593803DFF1E840ULL, 0xF4F076E65F2CE6F0ULL, 0x11379625747D5AF3ULL,
+    0xBCE5D2248682C115ULL, 0x9DA4243DE836994FULL, 0x066F70B33FE09017ULL, 0x4DC4DE189B671A1CULL,
+    0x51039AB7712457C3ULL, 0xC07A3F80C31FB4B4ULL, 0xB46EE9C5E64A6E7CULL, 0xB3819A42ABE61C87ULL,
+    0x21A007933A522A20ULL, 0x2DF16F761598AA4FULL, 0x763C4A1371B368FDULL, 0xF793C46702E086A0ULL,
+    0xD7288E012AEB8D31ULL, 0xDE336A2A4BC1C44BULL, 0x0BF692B38D079F23ULL, 0x2C604A7A177326B3ULL,
+    0x4850E73E03EB6064ULL, 0xCFC447F1E53C8E1BULL, 0xB05CA3F564268D99ULL, 0x9AE182C8BC9474E8ULL,
+    0xA4FC4BD4FC5558CAULL, 0xE755178D58FC4E76ULL, 0x69B97DB1A4C03DFEULL, 0xF9B5B7C4ACC67C96ULL,
+    0xFC6A82D64B8655FBULL, 0x9C684CB6C4D24417ULL, 0x8EC97D2917456ED0ULL, 0x6703DF9D2924E97EULL,
+    0xC547F57E42A7444EULL, 0x78E37644E7CAD29EULL, 0xFE9A44E9362F05FAULL, 0x08BD35CC38336615ULL,
+    0x9315E5EB3A129ACEULL, 0x94061B871E04DF75ULL, 0xDF1D9F9D784BA010ULL, 0x3BBA57B68871B59DULL,
+    0xD2B7ADEEDED1F73FULL, 0xF7A255D83BC373F8ULL, 0xD7F4F2448C0CEB81ULL, 0xD95BE88CD210FFA7ULL,
+    0x336F52F8FF4728E7ULL, 0xA74049DAC312AC71ULL, 0xA2F61BB6E437FDB5ULL, 0x4F2A5CB07F6A35B3ULL,
+    0x87D380BDA5BF7859ULL, 0x16B9F7E06C453A21ULL, 0x7BA2484C8A0FD54EULL, 0xF3A678CAD9A2E38CULL,
+    0x39B0BF7DDE437BA2ULL, 0xFCAF55C1BF8A4424ULL, 0x18FCF680573FA594ULL, 0x4C0563B89F495AC3ULL,
+    0x40E087931A00930DULL, 0x8CFFA9412EB642C1ULL, 0x68CA39053261169FULL, 0x7A1EE967D27579E2ULL,
+    0x9D1D60E5076F5B6FULL, 0x3810E399B6F65BA2ULL, 0x32095B6D4AB5F9B1ULL, 0x35CAB62109DD038AULL,
+    0xA90B24499FCFAFB1ULL, 0x77A225A07CC2C6BDULL, 0x513E5E634C70E331ULL, 0x4361C0CA3F692F12ULL,
+    0xD941ACA44B20A45BULL, 0x528F7C8602C5807BULL, 0x52AB92BEB9613989ULL, 0x9D1DFA2EFC557F73ULL,
+    0x722FF175F572C348ULL, 0x1D1260A51107FE97ULL, 0x7A249A57EC0C9BA2ULL, 0x04208FE9E8F7F2D6ULL,
+    0x5A110C6058B920A0ULL, 0x0CD9A497658A5698ULL, 0x56FD23C8F9715A4CULL, 0x284C847B9D887AAEULL,
+    0x04FEABFBBDB619CBULL, 0x742E1E651C60BA83ULL, 0x9A9632E65904AD3CULL, 0x881B82A13B51B9E2ULL,
+    0x506E6744CD974924ULL, 0xB0183DB56FFC6A79ULL, 0x0ED9B915C66ED37EULL, 0x5E11E86D5873D484ULL,
+    0xF678647E3519AC6EULL, 0x1B85D488D0F20CC5ULL, 0xDAB9FE6525D89021ULL, 0x0D151D86ADB73615ULL,
+    0xA865A54EDCC0F019ULL, 0x93C42566AEF98FFBULL, 0x99E7AFEABE000731ULL, 0x48CBFF086DDF285AULL,
+    0x7F9B6AF1EBF78BAFULL, 0x58627E1A149BBA21ULL, 0x2CD16E2ABD791E33ULL, 0xD363EFF5F0977996ULL,
+    0x0CE2A38C344A6EEDULL, 0x1A804AADB9CFA741ULL, 0x907F30421D78C5DEULL, 0x501F65EDB3034D07ULL,
+    0x37624AE5A48FA6E9ULL, 0x957BAF61700CFF4EULL, 0x3A6C27934E31188AULL, 0xD49503536ABCA345ULL,
+    0x088E049589C432E0ULL, 0xF943AEE7FEBF21B8ULL, 0x6C3B8E3E336139D3ULL, 0x364F6FFA464EE52EULL,
+    0xD60F6DCEDC314222ULL, 0x56963B0DCA418FC0ULL, 0x16F50EDF91E513AFULL, 0xEF1955914B609F93ULL,
+    0x565601C0364E3228ULL, 0xECB53939887E8175ULL, 0xBAC7A9A18531294BULL, 0xB344C470397BBA52ULL,
+    0x65D34954DAF3CEBDULL, 0xB4B81B3FA97511E2ULL, 0xB422061193D6F6A7ULL, 0x071582401C38434DULL,
+    0x7A13F18BBEDC4FF5ULL, 0xBC4097B116C524D2ULL, 0x59B97885E2F2EA28ULL, 0x99170A5DC3115544ULL,
+    0x6F423357E7C6A9F9ULL, 0x325928EE6E6F8794ULL, 0xD0E4366228B03343ULL, 0x565C31F7DE89EA27ULL,
+    0x30F5611484119414ULL, 0xD873DB391292ED4FULL, 0x7BD94E1D8E17DEBCULL, 0xC7D9F16864A76E94ULL,
+    0x947AE053EE56E63CULL, 0xC8C93882F9475F5FULL, 0x3A9BF55BA91F81CAULL, 0xD9A11FBB3D9808E4ULL,
+    0x0FD22063EDC29FCAULL, 0xB3F256D8ACA0B0B9ULL, 0xB03031A8B4516E84ULL, 0x35DD37D5871448AFULL,
+    0xE9F6082B05542E4EULL, 0xEBFAFA33D7254B59ULL, 0x9255ABB50D532280ULL, 0xB9AB4CE57F2D34F3ULL,
+    0x693501D628297551ULL, 0xC62C58F97DD949BFULL, 0xCD454F8F19C5126AULL, 0xBBE83F4ECC2BDECBULL,
+    0xDC842B7E2819E230ULL, 0xBA89142E007503B8ULL, 0xA3BC941D0A5061CBULL, 0xE9F6760E32CD8021ULL,
+    0x09C7E552BC76492FULL, 0x852F54934DA55CC9ULL, 0x8107FCCF064FCF56ULL, 0x098954D51FFF6580ULL,
+    0x23B70EDB1955C4BFULL, 0xC330DE426430F69DULL, 0x4715ED43E8A45C0AULL, 0xA8D7E4DAB780A08DULL,
+    0x0572B974F03CE0BBULL, 0xB57D2E985E1419C7ULL, 0xE8D9ECBE2CF3D73FULL, 0x2FE4B17170E59750ULL,
+    0x11317BA87905E790ULL, 0x7FBF21EC8A1F45ECULL, 0x1725CABFCB045B00ULL, 0x964E915CD5E2B207ULL,
+    0x3E2B8BCBF016D66DULL, 0xBE7444E39328A0ACULL, 0xF85B2B4FBCDE44B7ULL, 0x49353FEA39BA63B1ULL,
+    0x1DD01AAFCD53486AULL, 0x1FCA8A92FD719F85ULL, 0xFC7C95D827357AFAULL, 0x18A6A990C8B35EBDULL,
+    0xCCCB7005C6B9C28DULL, 0x3BDBB92C43B17F26ULL, 0xAA70B5B4F89695A2ULL, 0xE94C39A54A98307FULL,
+    0xB7A0B174CFF6F36EULL, 0xD4DBA84729AF48ADULL, 0x2E18BC1AD9704A68ULL, 0x2DE0966DAF2F8B1CULL,
+    0xB9C11D5B1E43A07EULL, 0x64972D68DEE33360ULL, 0x94628D38D0C20584ULL, 0xDBC0D2B6AB90A559ULL,
+    0xD2733C4335C6A72FULL, 0x7E75D99D94A70F4DULL, 0x6CED1983376FA72BULL, 0x97FCAACBF030BC24ULL,
+    0x7B77497B32503B12ULL, 0x8547EDDFB81CCB94ULL, 0x79999CDFF70902CBULL, 0xCFFE1939438E9B24ULL,
+    0x829626E3892D95D7ULL, 0x92FAE24291F2B3F1ULL, 0x63E22C147B9C3403ULL, 0xC678B6D860284A1CULL,
+    0x5873888850659AE7ULL, 0x0981DCD296A8736DULL, 0x9F65789A6509A440ULL, 0x9FF38FED72E9052FULL,
+    0xE479EE5B9930578CULL, 0xE7F28ECD2D49EECDULL, 0x56C074A581EA17FEULL, 0x5544F7D774B14AEFULL,
+    0x7B3F0195FC6F290FULL, 0x12153635B2C0CF57ULL, 0x7F5126DBBA5E0CA7ULL, 0x7A76956C3EAFB413ULL,
+    0x3D5774A11D31AB39ULL, 0x8A1B083821F40CB4ULL, 0x7B4A38E32537DF62ULL, 0x950113646D1D6E03ULL,
+    0x4DA8979A0041E8A9ULL, 0x3BC36E078F7515D7ULL, 0x5D0A12F27AD310D1ULL, 0x7F9D1A2E1EBE1327ULL,
+    0xDA3A361B1C5157B1ULL, 0xDCDD7D20903D0C25ULL, 0x36833336D068F707ULL, 0xCE68341F79893389ULL,
+    0xAB9090168DD05F34ULL, 0x43954B3252DC25E5ULL, 0xB438C2B67F98E5E9ULL, 0x10DCD78E3851A492ULL,
+    0xDBC27AB5447822BFULL, 0x9B3CDB65F82CA382ULL, 0xB67B7896167B4C84ULL, 0xBFCED1B0048EAC50ULL,
+    0xA9119B60369FFEBDULL, 0x1FFF7AC80904BF45ULL, 0xAC12FB171817EEE7ULL, 0xAF08DA9177DDA93DULL,
+    0x1B0CAB936E65C744ULL, 0xB559EB1D04E5E932ULL, 0xC37B45B3F8D6F2BAULL, 0xC3A9DC228CAAC9E9ULL,
+    0xF3B8B6675A6507FFULL, 0x9FC477DE4ED681DAULL, 0x67378D8ECCEF96CBULL, 0x6DD856D94D259236ULL,
+    0xA319CE15B0B4DB31ULL, 0x073973751F12DD5EULL, 0x8A8E849EB32781A5ULL, 0xE1925C71285279F5ULL,
+    0x74C04BF1790C0EFEULL, 0x4DDA48153C94938AULL, 0x9D266D6A1CC0542CULL, 0x7440FB816508C4FEULL,
+    0x13328503DF48229FULL, 0xD6BF7BAEE43CAC40ULL, 0x4838D65F6EF6748FULL, 0x1E152328F3318DEAULL,
+    0x8F8419A348F296BFULL, 0x72C8834A5957B511ULL, 0xD7A023A73260B45CULL, 0x94EBC8ABCFB56DAEULL,
+    0x9FC10D0F989993E0ULL, 0xDE68A2355B93CAE6ULL, 0xA44CFE79AE538BBEULL, 0x9D1D84FCCE371425ULL,
+    0x51D2B1AB2DDFB636ULL, 0x2FD7E4B9E72CD38CULL, 0x65CA5B96B7552210ULL, 0xDD69A0D8AB3B546DULL,
+    0x604D51B25FBF70E2ULL, 0x73AA8A564FB7AC9EULL, 0x1A8C1E992B941148ULL, 0xAAC40A2703D9BEA0ULL,
+    0x764DBEAE7FA4F3A6ULL, 0x1E99B96E70A9BE8BULL, 0x2C5E9DEB57EF4743ULL, 0x3A938FEE32D29981ULL,
+    0x26E6DB8FFDF5ADFEULL, 0x469356C504EC9F9DULL, 0xC8763C5B08D1908CULL, 0x3F6C6AF859D80055ULL,
+    0x7F7CC39420A3A545ULL, 0x9BFB227EBDF4C5CEULL, 0x89039D79D6FC5C5CULL, 0x8FE88B57305E2AB6ULL,
+    0xA09E8C8C35AB96DEULL, 0xFA7E393983325753ULL, 0xD6B6D0ECC617C699ULL, 0xDFEA21EA9E7557E3ULL,
+    0xB67C1FA481680AF8ULL, 0xCA1E3785A9E724E5ULL, 0x1CFC8BED0D681639ULL, 0xD18D8549D140CAEAULL,
+    0x4ED0FE7E9DC91335ULL, 0xE4DBF0634473F5D2ULL, 0x1761F93A44D5AEFEULL, 0x53898E4C3910DA55ULL,
+    0x734DE8181F6EC39AULL, 0x2680B122BAA28D97ULL, 0x298AF231C85BAFABULL, 0x7983EED3740847D5ULL,
+    0x66C1A2A1A60CD889ULL, 0x9E17E49642A3E4C1ULL, 0xEDB454E7BADC0805ULL, 0x50B704CAB602C329ULL,
+    0x4CC317FB9CDDD023ULL, 0x66B4835D9EAFEA22ULL, 0x219B97E26FFC81BDULL, 0x261E4E4C0A333A9DULL,
+    0x1FE2CCA76517DB90ULL, 0xD7504DFA8816EDBBULL, 0xB9571FA04DC089C8ULL, 0x1DDC0325259B27DEULL,
+    0xCF3F4688801EB9AAULL, 0xF4F5D05C10CAB243ULL, 0x38B6525C21A42B0EULL, 0x36F60E2BA4FA6800ULL,
+    0xEB3593803173E0CEULL, 0x9C4CD6257C5A3603ULL, 0xAF0C317D32ADAA8AULL, 0x258E5A80C7204C4BULL,
+    0x8B889D624D44885DULL, 0xF4D14597E660F855ULL, 0xD4347F66EC8941C3ULL, 0xE699ED85B0DFB40DULL,
+    0x2472F6207C2D0484ULL, 0xC2A1E7B5B459AEB5ULL, 0xAB4F6451CC1D45ECULL, 0x63767572AE3D6174ULL,
+    0xA59E0BD101731A28ULL, 0x116D0016CB948F09ULL, 0x2CF9C8CA052F6E9FULL, 0x0B090A7560A968E3ULL,
+    0xABEEDDB2DDE06FF1ULL, 0x58EFC10B06A2068DULL, 0xC6E57A78FBD986E0ULL, 0x2EAB8CA63CE802D7ULL,
+    0x14A195640116F336ULL, 0x7C0828DD624EC390ULL, 0xD74BBE77E6116AC7ULL, 0x804456AF10F5FB53ULL,
+    0xEBE9EA2ADF4321C7ULL, 0x03219A39EE587A30ULL, 0x49787FEF17AF9924ULL, 0xA1E9300CD8520548ULL,
+    0x5B45E522E4B1B4EFULL, 0xB49C3B3995091A36ULL, 0xD4490AD526F14431ULL, 0x12A8F216AF9418C2ULL,
+    0x001F837CC7350524ULL, 0x1877B51E57A764D5ULL, 0xA2853B80F17F58EEULL, 0x993E1DE72D36D310ULL,
+    0xB3598080CE64A656ULL, 0x252F59CF0D9F04BBULL, 0xD23C8E176D113600ULL, 0x1BDA0492E7E4586EULL,
+    0x21E0BD5026C619BFULL, 0x3B097ADAF088F94EULL, 0x8D14DEDB30BE846EULL, 0xF95CFFA23AF5F6F4ULL,
+    0x3871700761B3F743ULL, 0xCA672B91E9E4FA16ULL, 0x64C8E531BFF53B55ULL, 0x241260ED4AD1E87DULL,
+    0x106C09B972D2E822ULL, 0x7FBA195410E5CA30ULL, 0x7884D9BC6CB569D8ULL, 0x0647DFEDCD894A29ULL,
+    0x63573FF03E224774ULL, 0x4FC8E9560F91B123ULL, 0x1DB956E450275779ULL, 0xB8D91274B9E9D4FBULL,
+    0xA2EBEE47E2FBFCE1ULL, 0xD9F1F30CCD97FB09ULL, 0xEFED53D75FD64E6BULL, 0x2E6D02C36017F67FULL,
+    0xA9AA4D20DB084E9BULL, 0xB64BE8D8B25396C1ULL, 0x70CB6AF7C2D5BCF0ULL, 0x98F076A4F7A2322EULL,
+    0xBF84470805E69B5FULL, 0x94C3251F06F90CF3ULL, 0x3E003E616A6591E9ULL, 0xB925A6CD0421AFF3ULL,
+    0x61BDD1307C66E300ULL, 0xBF8D5108E27E0D48ULL, 0x240AB57A8B888B20ULL, 0xFC87614BAF287E07ULL,
+    0xEF02CDD06FFDB432ULL, 0xA1082C0466DF6C0AULL, 0x8215E577001332C8ULL, 0xD39BB9C3A48DB6CFULL,
+    0x2738259634305C14ULL, 0x61CF4F94C97DF93DULL, 0x1B6BACA2AE4E125BULL, 0x758F450C88572E0BULL,
+    0x959F587D507A8359ULL, 0xB063E962E045F54DULL, 0x60E8ED72C0DFF5D1ULL, 0x7B64978555326F9FULL,
+    0xFD080D236DA814BAULL, 0x8C90FD9B083F4558ULL, 0x106F72FE81E2C590ULL, 0x7976033A39F7D952ULL,
+    0xA4EC0132764CA04BULL, 0x733EA705FAE4FA77ULL, 0xB4D8F77BC3E56167ULL, 0x9E21F4F903B33FD9ULL,
+    0x9D765E419FB69F6DULL, 0xD30C088BA61EA5EFULL, 0x5D94337FBFAF7F5BULL, 0x1A4E4822EB4D7A59ULL,
+    0x6FFE73E81B637FB3ULL, 0xDDF957BC36D8B9CAULL, 0x64D0E29EEA8838B3ULL, 0x08DD9BDFD96B9F63ULL,
+    0x087E79E5A57D1D13ULL, 0xE328E230E3E2B3FBULL, 0x1C2559E30F0946BEULL, 0x720BF5F26F4D2EAAULL,
+    0xB0774D261CC609DBULL, 0x443F64EC5A371195ULL, 0x4112CF68649A260EULL, 0xD813F2FAB7F5C5CAULL,
+    0x660D3257380841EEULL, 0x59AC2C7873F910A3ULL, 0xE846963877671A17ULL, 0x93B633ABFA3469F8ULL,
+    0xC0C0F5A60EF4CDCFULL, 0xCAF21ECD4377B28CULL, 0x57277707199B8175ULL, 0x506C11B9D90E8B1DULL,
+    0xD83CC2687A19255FULL, 0x4A29C6465A314CD1ULL, 0xED2DF21216235097ULL, 0xB5635C95FF7296E2ULL,
+    0x22AF003AB672E811ULL, 0x52E762596BF68235ULL, 0x9AEBA33AC6ECC6B0ULL, 0x944F6DE09134DFB6ULL,
+    0x6C47BEC883A7DE39ULL, 0x6AD047C430A12104ULL, 0xA5B1CFDBA0AB4067ULL, 0x7C45D833AFF07862ULL,
+    0x5092EF950A16DA0BULL, 0x9338E69C052B8E7BULL, 0x455A4B4CFE30E3F5ULL, 0x6B02E63195AD0CF8ULL,
+    0x6B17B224BAD6BF27ULL, 0xD1E0CCD25BB9C169ULL, 0xDE0C89A556B9AE70ULL, 0x50065E535A213CF6ULL,
+    0x9C1169FA2777B874ULL, 0x78EDEFD694AF1EEDULL, 0x6DC93D9526A50E68ULL, 0xEE97F453F06791EDULL,
+    0x32AB0EDB696703D3ULL, 0x3A6853C7E70757A7ULL, 0x31865CED6120F37DULL, 0x67FEF95D92607890ULL,
+    0x1F2B1D1F15F6DC9CULL, 0xB69E38A8965C6B65ULL, 0xAA9119FF184CCCF4ULL, 0xF43C732873F24C13ULL,
+    0xFB4A3D794A9A80D2ULL, 0x3550C2321FD6109CULL, 0x371F77E76BB8417EULL, 0x6BFA9AAE5EC05779ULL,
+    0xCD04F3FF001A4778ULL, 0xE3273522064480CAULL, 0x9F91508BFFCFC14AULL, 0x049A7F41061A9E60ULL,
+    0xFCB6BE43A9F2FE9BULL, 0x08DE8A1C7797DA9BULL, 0x8F9887E6078735A1ULL, 0xB5B4071DBFC73A66ULL,
+    0x230E343DFBA08D33ULL, 0x43ED7F5A0FAE657DULL, 0x3A88A0FBBCB05C63ULL, 0x21874B8B4D2DBC4FULL,
+    0x1BDEA12E35F6A8C9ULL, 0x53C065C6C8E63528ULL, 0xE34A1D250E7A8D6BULL, 0xD6B04D3B7651DD7EULL,
+    0x5E90277E7CB39E2DULL, 0x2C046F22062DC67DULL, 0xB10BB459132D0A26ULL, 0x3FA9DDFB67E2F199ULL,
+    0x0E09B88E1914F7AFULL, 0x10E8B35AF3EEAB37ULL, 0x9EEDECA8E272B933ULL, 0xD4C718BC4AE8AE5FULL,
+    0x81536D601170FC20ULL, 0x91B534F885818A06ULL, 0xEC8177F83F900978ULL, 0x190E714FADA5156EULL,
+    0xB592BF39B0364963ULL, 0x89C350C893AE7DC1ULL, 0xAC042E70F8B383F2ULL, 0xB49B52E587A1EE60ULL,
+    0xFB152FE3FF26DA89ULL, 0x3E666E6F69AE2C15ULL, 0x3B544EBE544C19F9ULL, 0xE805A1E290CF2456ULL,
+    0x24B33C9D7ED25117ULL, 0xE74733427B72F0C1ULL, 0x0A804D18B7097475ULL, 0x57E3306D881EDB4FULL,
+    0x4AE7D6A36EB5DBCBULL, 0x2D8D5432157064C8ULL, 0xD1E649DE1E7F268BULL, 0x8A328A1CEDFE552CULL,
+    0x07A3AEC79624C7DAULL, 0x84547DDC3E203C94ULL, 0x990A98FD5071D263ULL, 0x1A4FF12616EEFC89ULL,
+    0xF6F7FD1431714200ULL, 0x30C05B1BA332F41CULL, 0x8D2636B81555A786ULL, 0x46C9FEB55D120902ULL,
+    0xCCEC0A73B49C9921ULL, 0x4E9D2827355FC492ULL, 0x19EBB029435DCB0FULL, 0x4659D2B743848A2CULL,
+    0x963EF2C96B33BE31ULL, 0x74F85198B05A2E7DULL, 0x5A0F544DD2B1FB18ULL, 0x03727073C2E134B1ULL,
+    0xC7F6AA2DE59AEA61ULL, 0x352787BAA0D7C22FULL, 0x9853EAB63B5E0B35ULL, 0xABBDCDD7ED5C0860ULL,
+    0xCF05DAF5AC8D77B0ULL, 0x49CAD48CEBF4A71EULL, 0x7A4C10EC2158C4A6ULL, 0xD9E92AA246BF719EULL,
+    0x13AE978D09FE5557ULL, 0x730499AF921549FFULL, 0x4E4B705B92903BA4ULL, 0xFF577222C14F0A3AULL,
+    0x55B6344CF97AAFAEULL, 0xB862225B055B6960ULL, 0xCAC09AFBDDD2CDB4ULL, 0xDAF8E9829FE96B5FULL,
+    0xB5FDFC5D3132C498ULL, 0x310CB380DB6F7503ULL, 0xE87FBB46217A360EULL, 0x2102AE466EBB1148ULL,
+    0xF8549E1A3AA5E00DULL, 0x07A69AFDCC42261AULL, 0xC4C118BFE78FEAAEULL, 0xF9F4892ED96BD438ULL,
+    0x1AF3DBE25D8F45DAULL, 0xF5B4B0B0D2DEEEB4ULL, 0x962ACEEFA82E1C84ULL, 0x046E3ECAAF453CE9ULL,
+    0xF05D129681949A4CULL, 0x964781CE734B3C84ULL, 0x9C2ED44081CE5FBDULL, 0x522E23F3925E319EULL,
+    0x177E00F9FC32F791ULL, 0x2BC60A63A6F3B3F2ULL, 0x222BBFAE61725606ULL, 0x486289DDCC3D6780ULL,
+    0x7DC7785B8EFDFC80ULL, 0x8AF38731C02BA980ULL, 0x1FAB64EA29A2DDF7ULL, 0xE4D9429322CD065AULL,
+    0x9DA058C67844F20CULL, 0x24C0E332B70019B0ULL, 0x233003B5A6CFE6ADULL, 0xD586BD01C5C217F6ULL,
+    0x5E5637885F29BC2BULL, 0x7EBA726D8C94094BULL, 0x0A56A5F0BFE39272ULL, 0xD79476A84EE20D06ULL,
+    0x9E4C1269BAA4BF37ULL, 0x17EFEE45B0DEE640ULL, 0x1D95B0A5FCF90BC6ULL, 0x93CBE0B699C2585DULL,
+    0x65FA4F227A2B6D79ULL, 0xD5F9E858292504D5ULL, 0xC2B5A03F71471A6FULL, 0x59300222B4561E00ULL,
+    0xCE2F8642CA0712DCULL, 0x7CA9723FBB2E8988ULL, 0x2785338347F2BA08ULL, 0xC61BB3A141E50E8CULL,
+    0x150F361DAB9DEC26ULL, 0x9F6A419D382595F4ULL, 0x64A53DC924FE7AC9ULL, 0x142DE49FFF7A7C3DULL,
+    0x0C335248857FA9E7ULL, 0x0A9C32D5EAE45305ULL, 0xE6C42178C4BBB92EULL, 0x71F1CE2490D20B07ULL,
+    0xF1BCC3D275AFE51AULL, 0xE728E8C83C334074ULL, 0x96FBF83A12884624ULL, 0x81A1549FD6573DA5ULL,
+    0x5FA7867CAF35E149ULL, 0x56986E2EF3ED091BULL, 0x917F1DD5F8886C61ULL, 0xD20D8C88C8FFE65FULL,
+    0x31D71DCE64B2C310ULL, 0xF165B587DF898190ULL, 0xA57E6339DD2CF3A0ULL, 0x1EF6E6DBB1961EC9ULL,
+    0x70CC73D90BC26E24ULL, 0xE21A6B35DF0C3AD7ULL, 0x003A93D8B2806962ULL, 0x1C99DED33CB890A1ULL,
+    0xCF3145DE0ADD4289ULL, 0xD0E4427A5514FB72ULL, 0x77C621CC9FB3A483ULL, 0x67A34DAC4356550BULL,
+    0xF8D626AAAF278509ULL
+};
+
+#define book_entry_size 16
+
+int own_book = 0;
+HANDLE book_file = nullptr, book_mapping = nullptr;
+const unsigned char* book_data = nullptr;
+U64 book_entries = 0;
+U64 book_random_state = 0;
+
+// Polyglot hash of the current position
+static U64 polyglot_key(){
+    U64 key = 0ULL;
+
+    for (int piece = P; piece <= k; piece++){
+        // black pawn, white pawn, black knight, ...
+        int kind = 2 * (piece % 6) + ((piece < p) ? 1 : 0);
+        U64 bitboard = bitboards[piece];
+
+        while (bitboard){
+            int square = get_ls1b_index(bitboard);
+            popSquare(bitboard, square);
+            // rank 1 first there, rank 8 first here
+            key ^= polyglot_random[64 * kind + (square ^ 56)];
+        }
+    }
+
+    if (castle & wk) key ^= polyglot_random[768];
+    if (castle & wq) key ^= polyglot_random[769];
+    if (castle & bk) key ^= polyglot_random[770];
+    if (castle & bq) key ^= polyglot_random[771];
+
+    // en passant only counts when a pawn can take
+    if (enpassant != no_sq && (pawn_attacks[side ^ 1][enpassant] & bitboards[(side == white) ? P : p]))
+        key ^= polyglot_random[772 + enpassant % 8];
+
+    if (side == white) key ^= polyglot_random[780];
+
+    return key;
+}
+
+static inline U64 read_big_endian(const unsigned char* bytes, int count){
+    U64 value = 0ULL;
+    for (int index = 0; index < count; index++) value = (value << 8) | bytes[index];
+    return value;
+}
+
+// book move (to 0-5, from 6-11, promotion 12-14) to our move, 0 if it isn't legal here
+static int book_move_to_move(int book_move){
+    // rank 1 first there
+    int target = (book_move & 63) ^ 56;
+    int source = ((book_move >> 6) & 63) ^ 56;
+    int promotion = (book_move >> 12) & 7;
+
+    moves move_list[1];
+    generate_moves(move_list);
+
+    for (int count = 0; count < move_list->count; count++){
+        int move = move_list->moves[count];
+        int move_target = get_move_target(move);
+
+        // castling is the king taking its own rook there
+        if (get_move_castling(move)) move_target = (move_target % 8 == 6) ? move_target + 1 : move_target - 2;
+
+        if (get_move_source(move) != source || move_target != target) continue;
+        if (get_move_promoted(move) % 6 != promotion) continue;
+
+        // and it must not leave the king in check
+        copy_board();
+        int legal = make_move(move, all_moves);
+        take_back();
+        if (legal) return move;
+    }
+
+    return 0;
+}
+
+// a book move for the current position, weighted by the entries' weights, 0 if out of book
+int probe_book(){
+    if (!book_data) return 0;
+
+    U64 key = polyglot_key();
+
+    // first entry with this key
+    U64 low = 0, high = book_entries;
+    while (low < high){
+        U64 middle = (low + high) / 2;
+        if (read_big_endian(book_data + middle * book_entry_size, 8) < key) low = middle + 1;
+        else high = middle;
+    }
+
+    int candidates[64], weights[64], count = 0, total_weight = 0;
+    for (U64 entry = low; entry < book_entries && count < 64; entry++){
+        const unsigned char* bytes = book_data + entry * book_entry_size;
+        if (read_big_endian(bytes, 8) != key) break;
+
+        int move = book_move_to_move((int)read_big_endian(bytes + 8, 2));
+        int weight = (int)read_big_endian(bytes + 10, 2);
+        if (!move || !weight) continue;
+
+        candidates[count] = move;
+        weights[count++] = weight;
+        total_weight += weight;
+    }
+
+    if (!count) return 0;
+
+    // xorshift, seeded when the book is loaded
+    book_random_state ^= book_random_state << 13;
+    book_random_state ^= book_random_state >> 7;
+    book_random_state ^= book_random_state << 17;
+
+    int pick = (int)(book_random_state % (U64)total_weight);
+    for (int index = 0; index < count; index++){
+        if (pick < weights[index]) return candidates[index];
+        pick -= weights[index];
+    }
+
+    return candidates[0];
+}
+
+void unload_book(){
+    if (book_data){
+        UnmapViewOfFile(book_data);
+        CloseHandle(book_mapping);
+        CloseHandle(book_file);
+    }
+
+    book_data = nullptr;
+    book_file = book_mapping = nullptr;
+    book_entries = 0;
+}
+
+// map a Polyglot book, replacing the current one
+void load_book(const char* path){
+    unload_book();
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE){
+        std::cout << "info string book " << path << " not found" << std::endl;
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < book_entry_size){
+        CloseHandle(file);
+        std::cout << "info string book " << path << " is empty" << std::endl;
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view){
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        std::cout << "info string book " << path << " can't be mapped" << std::endl;
+        return;
+    }
+
+    book_file = file;
+    book_mapping = mapping;
+    book_data = (const unsigned char*)view;
+    book_entries = (U64)file_size.QuadPart / book_entry_size;
+    book_random_state = (U64)get_time_ms() * 0x9E3779B97F4A7C15ULL | 1;
+
+    std::cout << "info string book " << path << " loaded, " << book_entries << " entries" << std::endl;
+}
+
+/*
+      ================================
+               PGN reader
+      --------------------------------
+      The PGN file is mapped and cut into batches, and each batch
+      into one chunk per thread at "[Event" tags, so no game is
+      split. Threads only tokenize: tags, comments, variations,
+      NAGs and move numbers are skipped and the SAN moves are kept
+      as pointers into the mapping. The games are then played over
+      the board in file order, each SAN resolved against the moves
+      of generate_moves(), since the board is global.
+      ================================
+*/
+enum { pgn_black_win, pgn_draw, pgn_white_win, pgn_unknown };
+
+// a batch of text tokenized at once, so the tokens of huge files don't pile up
+#define pgn_batch_size (64 << 20)
+
+typedef struct {
+    const char* text;
+    int length;
+} pgn_token;
+
+typedef struct {
+    U64 first_move;         // in the chunk's moves
+    int move_count;
+    pgn_token fen;          // FEN tag, text nullptr for the start position
+    int result;             // Result tag, else the termination marker
+} pgn_game;
+
+typedef struct {
+    std::vector<pgn_game> games;
+    std::vector<pgn_token> moves;
+} pgn_chunk;
+
+// "1-0", "0-1", "1/2-1/2" or "*" at text, else pgn_unknown with length 0
+static int parse_pgn_result(const char* text, const char* end, int* length){
+    int left = (int)(end - text);
+    if (left >= 7 && strncmp(text, "1/2-1/2", 7) == 0){ *length = 7; return pgn_draw; }
+    if (left >= 3 && strncmp(text, "1-0", 3) == 0){ *length = 3; return pgn_white_win; }
+    if (left >= 3 && strncmp(text, "0-1", 3) == 0){ *length = 3; return pgn_black_win; }
+    if (left >= 1 && *text == '*'){ *length = 1; return pgn_unknown; }
+    *length = 0;
+    return pgn_unknown;
+}
+
+// start of the first game at or after from
+static const char* next_pgn_game(const char* text, const char* from, const char* end){
+    for (const char* c = from; c + 6 <= end; c++)
+        if (*c == '[' && (c == text || c[-1] == '\n') && strncmp(c, "[Event", 6) == 0) return c;
+    return end;
+}
+
+// split [begin, end) into games and SAN moves
+static void tokenize_pgn(const char* begin, const char* end, pgn_chunk* chunk){
+    pgn_game game = { chunk->moves.size(), 0, { nullptr, 0 }, pgn_unknown };
+    int tag_result = pgn_unknown, has_tags = 0, in_moves = 0;
+
+    auto finish_game = [&](int result){
+        if (has_tags || game.move_count){
+            game.result = (tag_result != pgn_unknown) ? tag_result : result;
+            chunk->games.push_back(game);
+        }
+        game = { chunk->moves.size(), 0, { nullptr, 0 }, pgn_unknown };
+        tag_result = pgn_unknown;
+        has_tags = in_moves = 0;
+    };
+
+    const char* c = begin;
+    while (c < end){
+        char letter = *c;
+
+        if (letter == ' ' || letter == '\n' || letter == '\r' || letter == '\t' || letter == '.'){ c++; continue; }
+
+        // tag pair: a tag after the moves is the next game without a result
+        if (letter == '['){
+            if (in_moves) finish_game(pgn_unknown);
+            has_tags = 1;
+
+            const char* name = ++c;
+            while (c < end && *c != ' ' && *c != ']') c++;
+            int name_length = (int)(c - name);
+
+            while (c < end && *c != '"' && *c != ']') c++;
+            const char* value = (c < end && *c == '"') ? ++c : c;
+            while (c < end && *c != '"' && *c != ']') c++;
+            int value_length = (int)(c - value);
+
+            if (name_length == 3 && strncmp(name, "FEN", 3) == 0) game.fen = { value, value_length };
+            if (name_length == 6 && strncmp(name, "Result", 6) == 0){
+                int length;
+                tag_result = parse_pgn_result(value, value + value_length, &length);
+            }
+
+            while (c < end && *c != '\n') c++;
+            continue;
+        }
+
+        // comments, escaped lines
+        if (letter == '{'){ while (c < end && *c != '}') c++; c++; continue; }
+        if (letter == ';' || (letter == '%' && (c == begin || c[-1] == '\n'))){ while (c < end && *c != '\n') c++; continue; }
+
+        // variations, comments included
+        if (letter == '('){
+            int depth = 0;
+            while (c < end){
+                if (*c == '{'){ while (c < end && *c != '}') c++; }
+                else if (*c == '(') depth++;
+                else if (*c == ')' && --depth == 0) break;
+                c++;
+            }
+            c++;
             continue;
         }
 
-        // score current move
-        int score = -quiescence(-beta, -alpha);
-        ply--;
-
-        take_back();
+        // NAGs
+        if (letter == '$'){ c++; while (c < end && *c >= '0' && *c <= '9') c++; continue; }
 
-        if (stopped == 1) return 0;
+        in_moves = 1;
 
-        if (score >= beta){
-            // node (move) fails high
-            return beta;
+        // termination marker, else move number ("0-0" and "0-0-0" are castling)
+        int length;
+        int result = parse_pgn_result(c, end, &length);
+        if (length){
+            c += length;
+            finish_game(result);
+            continue;
         }
+        int zero_castling = (letter == '0' && end - c >= 3 && c[1] == '-' && c[2] == '0');
+        if (letter >= '0' && letter <= '9' && !zero_castling){ while (c < end && *c >= '0' && *c <= '9') c++; continue; }
 
-        if (score > alpha){
-            // PV node (move)
-            alpha = score;
-        }
+        // SAN move
+        const char* san = c;
+        while (c < end && *c != ' ' && *c != '\n' && *c != '\r' && *c != '\t' && *c != '{' && *c != '(' && *c != ')' && *c != ';' && *c != '$')
+            c++;
+
+        chunk->moves.push_back({ san, (int)(c - san) });
+        game.move_count++;
     }
 
-    // node (move) fails low
-    return alpha;
+    finish_game(pgn_unknown);
 }
 
-//negamax alpha beta search with fail-hard approach -> maybe also implement soft? TBD
-const int full_depth_moves = 4;
-const int reduction_limit = 3;
-static inline int negamax(int alpha, int beta, int depth){
-    // every 2047 nodes
-    if ((nodes & 2047) == 0)
-        // "listen" to the GUI/user input
-        communicate();
+// SAN move ("Nbxd7+", "e8=Q", "O-O") to a legal move in the current position, 0 if none
+int parse_san(const char* san, int length){
+    // annotations
+    while (length > 0 && (san[length - 1] == '+' || san[length - 1] == '#' || san[length - 1] == '!' || san[length - 1] == '?'))
+        length--;
+    if (length < 2) return 0;
 
-    // init PV length
-    pv_length[ply] = ply;
+    moves move_list[1];
+    generate_moves(move_list);
 
-    if (depth == 0)
-        // return evaluation
-        return quiescence(alpha, beta);
+    int castling = 0, type = P, promoted = 0, target = -1, from_file = -1, from_rank = -1;
 
-    // we are too deep, so there's an overflow of arrays
-    if (ply > max_ply - 1)
-        // evaluate position
-        return evaluate();
+    if (san[0] == 'O' || san[0] == '0') castling = (length >= 5) ? 2 : 1;
+    else {
+        int first = 0;
+        const char* letter = strchr("NBRQK", san[0]);
+        if (letter && *letter){ type = (int)(letter - "NBRQK") + N; first = 1; }
+
+        // promotion, "=Q" or just "Q"
+        if (type == P && strchr("NBRQ", san[length - 1])){
+            promoted = (int)(strchr("NBRQ", san[length - 1]) - "NBRQ") + N;
+            length -= (san[length - 2] == '=') ? 2 : 1;
+        }
+        if (length - first < 2) return 0;
 
-    nodes++;
+        int file = san[length - 2] - 'a', rank = san[length - 1] - '1';
+        if (file < 0 || file > 7 || rank < 0 || rank > 7) return 0;
+        target = (7 - rank) * 8 + file;
 
-    //is king in check
-    int in_check = is_square_attacked((side == white) ? get_ls1b_index(bitboards[K]) :
-                                                        get_ls1b_index(bitboards[k]),
-                                                        side ^ 1);
+        // disambiguation, the capture sign aside
+        for (int index = first; index < length - 2; index++){
+            if (san[index] >= 'a' && san[index] <= 'h') from_file = san[index] - 'a';
+            else if (san[index] >= '1' && san[index] <= '8') from_rank = san[index] - '1';
+        }
+    }
 
-    // increase depth if in check because you can get mated
-    if (in_check) depth++;
+    for (int count = 0; count < move_list->count; count++){
+        int move = move_list->moves[count];
 
-    int legal_moves = 0;
+        if (castling){
+            if (!get_move_castling(move) || (get_move_target(move) % 8 == 6) != (castling == 1)) continue;
+        }
+        else {
+            int source = get_move_source(move);
+            if (get_move_castling(move) || get_move_piece(move) % 6 != type || get_move_target(move) != target) continue;
+            if ((from_file >= 0 && source % 8 != from_file) || (from_rank >= 0 && 7 - source / 8 != from_rank)) continue;
+            if (get_move_promoted(move) % 6 != promoted) continue;
+        }
 
-    // null move pruning
-    if (depth >= 3 && in_check == 0 && ply){
+        // SAN leaves out the pinned piece when disambiguating
         copy_board();
-
-        // switch the side, giving opponent an extra move to make
-        side ^= 1;
-
-        // reset enpassant capture square
-        enpassant = no_sq;
-
-        /* search moves with reduced depth to find beta cutoffs
-           depth - 1 - R where R is a reduction limit */
-        int score = -negamax(-beta, -beta + 1, depth - 1 - 2);
-
+        int legal = make_move(move, all_moves);
         take_back();
+        if (legal) return move;
+    }
 
-        if (stopped == 1) return 0;
+    return 0;
+}
 
-        // fail-hard beta cutoff
-        if (score >= beta)
-            // node (move) fails high
-            return beta;
+// read a PGN file with threads tokenizing, then play its games in file order:
+// on_position(game, game_ply, move) in the position before each move, returns the games read
+template <typename F>
+U64 read_pgn(const char* path, int threads, F on_position){
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE){
+        std::cout << "info string " << path << " not found" << std::endl;
+        return 0;
     }
 
-    moves move_list[1];
-    generate_moves(move_list);
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    void* view = nullptr;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0){
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    }
+    if (!view){
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        std::cout << "info string " << path << " can't be mapped" << std::endl;
+        return 0;
+    }
 
-    // if we are now following PV line
-    if (follow_pv)
-        // enable PV move scoring
-        enable_pv_scoring(move_list);
+    const char* text = (const char*)view;
+    const char* text_end = text + file_size.QuadPart;
+    std::vector<pgn_chunk> chunks(threads);
+    U64 game_count = 0, cut_games = 0;
+    pgn_token first_unreadable = { nullptr, 0 };
+    U64 first_unreadable_game = 0;
+    char fen[256];
+
+    for (const char* batch = next_pgn_game(text, text, text_end); batch < text_end; ){
+        const char* batch_end = (text_end - batch > pgn_batch_size) ? next_pgn_game(text, batch + pgn_batch_size, text_end) : text_end;
+
+        // one chunk per thread, cut at game starts
+        std::vector<std::thread> workers;
+        const char* chunk_begin = batch;
+        for (int thread = 0; thread < threads; thread++){
+            const char* chunk_end = (thread == threads - 1) ? batch_end
+                : std::max(chunk_begin, next_pgn_game(text, batch + (batch_end - batch) * (thread + 1) / threads, batch_end));
+
+            chunks[thread].games.clear();
+            chunks[thread].moves.clear();
+            workers.emplace_back(tokenize_pgn, chunk_begin, chunk_end, &chunks[thread]);
+            chunk_begin = chunk_end;
+        }
+        for (auto& worker : workers) worker.join();
+
+        // the board is global: games are played one by one
+        for (const pgn_chunk& chunk : chunks){
+            for (const pgn_game& game : chunk.games){
+                if (game.fen.text){
+                    int length = std::min(game.fen.length, (int)sizeof(fen) - 9);
+                    memcpy(fen, game.fen.text, length);
+                    // the fields a short FEN may leave out
+                    memcpy(fen + length, " - - 0 1", 9);
+                    parse_fen(fen);
+                }
+                else parse_fen(start_position);
 
+                for (int game_ply = 0; game_ply < game.move_count; game_ply++){
+                    const pgn_token& san = chunk.moves[game.first_move + game_ply];
+                    int move = parse_san(san.text, san.length);
 
-    sort_moves(move_list);
+                    // the rest of a game with an unreadable move is lost
+                    if (!move){
+                        if (!cut_games++){
+                            first_unreadable = san;
+                            first_unreadable_game = game_count + 1;
+                        }
+                        break;
+                    }
 
-    // number of moves searched in a move list
-    int moves_searched = 0;
+                    on_position(game, game_ply, move);
+                    make_move(move, all_moves);
+                }
 
-    // loop over moves within a movelist
-    for (int count = 0; count < move_list->count; count++){
-        // preserve board state
-        copy_board();
+                game_count++;
+            }
+        }
 
-        ply++;
+        batch = batch_end;
+    }
 
-        // make sure to make only legal moves
-        if (make_move(move_list->moves[count], all_moves) == 0){
-            // decrement ply
-            ply--;
-            continue;
-        }
+    if (cut_games)
+        std::cout << "info string " << cut_games << " games cut short at an unreadable move, the first in game "
+                  << first_unreadable_game << ": " << std::string(first_unreadable.text, std::min(first_unreadable.length, 32)) << std::endl;
 
-        legal_moves++;
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
 
-        int score;
-        // full depth search
-        if (moves_searched == 0)
-            // do normal alpha beta search
-            score = -negamax(-beta, -alpha, depth - 1);
+    return game_count;
+}
 
-        // late move reduction (LMR)
-        else{
-            // condition to consider LMR
-            if (
-                moves_searched >= full_depth_moves &&
-                depth >= reduction_limit &&
-                in_check == 0 &&
-                get_move_capture(move_list->moves[count]) == 0 &&
-                get_move_promoted(move_list->moves[count]) == 0
-                )
-                // search current move with reduced depth:
-                score = -negamax(-alpha - 1, -alpha, depth - 2);
+// move of a book entry: to 0-5, from 6-11, promotion 12-14, castling as the king taking its rook
+static int move_to_book_move(int move){
+    int source = get_move_source(move), target = get_move_target(move);
+    if (get_move_castling(move)) target = (target % 8 == 6) ? target + 1 : target - 2;
 
-            // hack to ensure that full-depth search is done
-            else score = alpha + 1;
+    return (target ^ 56) | ((source ^ 56) << 6) | ((get_move_promoted(move) % 6) << 12);
+}
 
-            // if found a better move during LMR
-            if (score > alpha){
-                /* Once you've found a move with a score that is between alpha and beta,
-                the rest of the moves are searched with the goal of proving that they are all bad.
-                It's possible to do this a bit faster than a search that worries that one
-                of the remaining moves might be good. */
-                score = -negamax(-alpha - 1, -alpha, depth - 1);
+typedef struct {
+    U64 key;
+    int move;
+    int points;             // 2 for a win, 1 for a draw of the side moving
+    int games;
+} book_statistic;
+
+// statistics are kept by (position key, book move): only the same move in the same position is merged
+typedef std::pair<U64, int> book_statistic_key;
+
+struct book_statistic_hash {
+    size_t operator()(const book_statistic_key& key) const {
+        return (size_t)(key.first ^ ((U64)key.second * 0x9E3779B97F4A7C15ULL));
+    }
+};
 
-                /* If the algorithm finds out that it was wrong, and that one of the
-                subsequent moves was better than the first PV move, it has to search again,
-                in the normal alpha-beta manner.  This happens sometimes, and it's a waste of time,
-                but generally not often enough to counteract the savings gained from doing the
-                "bad move proof" search referred to earlier. */
-                if ((score > alpha) && (score < beta))
-                    score = -negamax(-beta, -alpha, depth - 1);
-            }
+// Polyglot book from the games of a PGN: their first book_plies plies, moves played in at least min_games games,
+// weighted by the points they scored
+void make_book(const char* pgn_path, const char* book_path, int book_plies, int min_games, int threads){
+    long long start = get_time_ms();
+
+    // statistics by position and move
+    std::unordered_map<book_statistic_key, book_statistic, book_statistic_hash> statistics;
+
+    U64 games = read_pgn(pgn_path, threads, [&](const pgn_game& game, int game_ply, int move){
+        if (game_ply >= book_plies) return;
+
+        U64 key = polyglot_key();
+        int book_move = move_to_book_move(move);
+        book_statistic& statistic = statistics[book_statistic_key(key, book_move)];
+        statistic.key = key;
+        statistic.move = book_move;
+        statistic.games++;
+        if (game.result != pgn_unknown)
+            statistic.points += (side == white) ? game.result : 2 - game.result;
+    });
+
+    std::vector<book_statistic> entries;
+    for (const auto& statistic : statistics)
+        if (statistic.second.games >= min_games && statistic.second.points > 0) entries.push_back(statistic.second);
+
+    // by key, the best move first
+    std::sort(entries.begin(), entries.end(), [](const book_statistic& a, const book_statistic& b){
+        return (a.key != b.key) ? a.key < b.key : a.points > b.points;
+    });
+
+    FILE* file = nullptr;
+    fopen_s(&file, book_path, "wb");
+    if (!file){
+        std::cout << "info string can't write " << book_path << std::endl;
+        return;
+    }
+
+    for (size_t first = 0; first < entries.size(); ){
+        // weights are 16 bits: scaled down per position when a move scored more
+        size_t last = first;
+        int best = 0;
+        while (last < entries.size() && entries[last].key == entries[first].key) best = std::max(best, entries[last++].points);
+
+        for (size_t index = first; index < last; index++){
+            int weight = (best > 65535) ? std::max(1, (int)((long long)entries[index].points * 65535 / best)) : entries[index].points;
+
+            unsigned char bytes[book_entry_size] = { 0 };
+            for (int byte = 0; byte < 8; byte++) bytes[byte] = (unsigned char)(entries[index].key >> (56 - 8 * byte));
+            bytes[8] = (unsigned char)(entries[index].move >> 8);
+            bytes[9] = (unsigned char)entries[index].move;
+            bytes[10] = (unsigned char)(weight >> 8);
+            bytes[11] = (unsigned char)weight;
+            fwrite(bytes, 1, book_entry_size, file);
         }
-        
 
-        ply--;
+        first = last;
+    }
+    fclose(file);
 
-        take_back();
+    std::cout << "info string " << games << " games, " << entries.size() << " book entries written to " << book_path
+              << " in " << get_time_ms() - start << " ms" << std::endl;
+}
 
-        if (stopped == 1) return 0;
+/*
+      ================================
+              Training data
+      --------------------------------
+      "gendata" samples the positions of PGN games the way
+      training/pgn_to_dataset.py does: the position after each move
+      from min_ply on, kept with probability sample_rate, unfinished
+      games skipped. They are written as the 32-byte records of
+      packed_position.h, in one file or in shards of a fixed number
+      of records (name_000.bin, name_001.bin, ...), which the
+      PackedReader library maps and streams to training.
+      ================================
+*/
 
-        // increment the counter of moves searched so far
-        moves_searched++;
+// the current position as a record
+static packed_position pack_position(int result, int score, int game_ply){
+    packed_position packed;
+    memset(&packed, 0, sizeof(packed));
 
-        // fail-hard beta cutoff
-        if (score >= beta){
-            // on quiet moves
-            if (get_move_capture(move_list->moves[count]) == 0){
-                // store killer moves
-                killer_moves[1][ply] = killer_moves[0][ply];
-                killer_moves[0][ply] = move_list->moves[count];
-            }
-            // node (move) fails high
-            return beta;
-        }
+    packed.occupancy = occupancies[both];
 
-        // found a better move
-        if (score > alpha){
-            // on quiet moves
-            if (get_move_capture(move_list->moves[count]) == 0)
-                // store history moves
-                history_moves[get_move_piece(move_list->moves[count])][get_move_target(move_list->moves[count])] += depth;
+    U64 bitboard = occupancies[both];
+    for (int index = 0; bitboard; index++){
+        int square = get_ls1b_index(bitboard);
+        popSquare(bitboard, square);
 
-            // PV node (move)
-            alpha = score;
+        int piece = P;
+        while (!getSquare(bitboards[piece], square)) piece++;
+        packed.pieces[index / 2] |= (unsigned char)(piece << (4 * (index & 1)));
+    }
 
-            // write PV move
-            pv_table[ply][ply] = move_list->moves[count];
+    packed.flags = (unsigned char)(castle | ((side == black) ? 0x80 : 0));
+    packed.enpassant = (unsigned char)((enpassant == no_sq) ? 64 : enpassant);
+    packed.fifty = (unsigned char)std::min(fifty, 255);
+    packed.result = (signed char)result;
+    packed.score = (short)score;
+    packed.ply = (unsigned short)std::min(game_ply, 65535);
 
-            // loop over the next ply
-            for (int next_ply = ply + 1; next_ply < pv_length[ply + 1]; next_ply++)
-                // copy move from deeper ply into a current ply's line
-                pv_table[ply][next_ply] = pv_table[ply + 1][next_ply];
+    return packed;
+}
 
-            // adjust PV length
-            pv_length[ply] = pv_length[ply + 1];
-        }
-    }
+typedef struct {
+    std::string path;
+    U64 shard_size;         // records per shard, 0 for a single file
+    int shard;
+    U64 in_shard;
+    U64 written;
+    FILE* file;
+    std::vector<packed_position> buffer;
+} packed_writer;
+
+// the file of the writer's current shard: path itself, else name_000.bin, name_001.bin, ...
+static std::string packed_shard_name(const packed_writer* writer){
+    if (!writer->shard_size) return writer->path;
+
+    size_t dot = writer->path.find_last_of('.');
+    size_t slash = writer->path.find_last_of("\\/");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = writer->path.size();
+
+    char number[16];
+    snprintf(number, sizeof(number), "_%03d", writer->shard);
+    return writer->path.substr(0, dot) + number + writer->path.substr(dot);
+}
 
-    // no legal move in current position
-    if (legal_moves == 0){
-        // king is in check
-        if (in_check)
-            // return mating score (assuming closest distance to mating position)
-            return -49000 + ply;
+static void flush_packed_writer(packed_writer* writer){
+    if (writer->file && !writer->buffer.empty())
+        fwrite(writer->buffer.data(), sizeof(packed_position), writer->buffer.size(), writer->file);
+    writer->buffer.clear();
+}
 
-        //king is not in check
-        else
-            // return stalemate score
-            return 0;
+// start the next shard, 0 if it can't be written
+static int open_packed_shard(packed_writer* writer){
+    flush_packed_writer(writer);
+    if (writer->file){
+        fclose(writer->file);
+        writer->file = nullptr;
+        writer->shard++;
     }
 
-    // node (move) fails low
-    return alpha;
+    std::string name = packed_shard_name(writer);
+    fopen_s(&writer->file, name.c_str(), "wb");
+    writer->in_shard = 0;
+
+    if (!writer->file) std::cout << "info string can't write " << name << std::endl;
+    return writer->file != nullptr;
 }
 
-// search position for the best move
-void search_position(int depth){
-    int score = 0;
-    nodes = 0;
-    // reset follow PV flags
-    follow_pv = 0;
-    score_pv = 0;
-    // reset "time is up" flag
-    stopped = 0;
+static int open_packed_writer(packed_writer* writer, const char* path, U64 shard_size){
+    writer->path = path;
+    writer->shard_size = shard_size;
+    writer->shard = 0;
+    writer->written = 0;
+    writer->file = nullptr;
+    writer->buffer.reserve(1 << 16);
+    return open_packed_shard(writer);
+}
 
-    // clear helper data structures for search
-    memset(killer_moves, 0, sizeof(killer_moves));
-    memset(history_moves, 0, sizeof(history_moves));
-    memset(pv_table, 0, sizeof(pv_table));
-    memset(pv_length, 0, sizeof(pv_length));
+static void write_packed(packed_writer* writer, const packed_position& packed){
+    if (writer->shard_size && writer->in_shard == writer->shard_size && !open_packed_shard(writer)) return;
 
-    // define initial alpha beta bounds
-    int alpha = -50000;
-    int beta = 50000;
+    writer->buffer.push_back(packed);
+    writer->in_shard++;
+    writer->written++;
+    if (writer->buffer.size() == writer->buffer.capacity()) flush_packed_writer(writer);
+}
 
-    // iterative deepening
-    for (int current_depth = 1; current_depth <= depth; current_depth++){
+static void close_packed_writer(packed_writer* writer){
+    flush_packed_writer(writer);
+    if (writer->file) fclose(writer->file);
+    writer->file = nullptr;
+}
 
-        if (stopped == 1) break;
+// sample the positions of a PGN into records, in shards of shard_size records unless 0
+void generate_data(const char* pgn_path, const char* out_path, double sample_rate, int min_ply, U64 shard_size, int threads){
+    long long start = get_time_ms();
 
-        follow_pv = 1;
+    packed_writer writer;
+    if (!open_packed_writer(&writer, out_path, shard_size)) return;
 
-        // find best move within a given position
-        score = negamax(alpha, beta, current_depth);
+    U64 outcomes[3] = { 0, 0, 0 };
 
-        // we fell outside the window, so try again with a full-width window (and the same depth)
-        if ((score <= alpha) || (score >= beta)) {
-            alpha = -50000;
-            beta = 50000;
-            continue;
-        }
+    // xorshift, fixed seed: the same PGN gives the same data
+    U64 random_state = 42;
 
-        // set up the window for the next iteration
-        alpha = score - 50;
-        beta = score + 50;
+    U64 games = read_pgn(pgn_path, threads, [&](const pgn_game& game, int game_ply, int move){
+        if (game.result == pgn_unknown || game_ply + 1 < min_ply) return;
 
-        std::cout << "info score cp " << score << " depth " << current_depth << " nodes " << nodes << "pv ";
-        // loop over the moves within a PV line
-        for (int count = 0; count < pv_length[0]; count++) {
-            // print PV move
-            print_move(pv_table[0][count]);
-            std::cout << " ";
-        }
-        std::cout << "\n";
-    }
-    std::cout << "bestmove ";
-    print_move(pv_table[0][0]);
-    std::cout << std::endl;
-}
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        if ((double)(random_state >> 11) * (1.0 / 9007199254740992.0) >= sample_rate) return;
 
-// Optional: simple self-play data generation (fixed ply outcome labels)
-// Writes NPZ-compatible .npz via a tiny text intermediary (user converts) or prints to stdout.
-// For now, we provide a helper to dump features and outcomes to a .npz-like CSV.
-static void dump_features_and_result(const char* path, const std::vector<std::vector<float>>& X, const std::vector<float>& Z) {
-    FILE* f = nullptr;
-    fopen_s(&f, path, "w");
-    if (!f) return;
-    // CSV: first line dims, then rows of features and last column is z
-    fprintf(f, "N,%zu\n", X.size());
-    for (size_t i = 0; i < X.size(); ++i) {
-        const auto& v = X[i];
-        for (size_t j = 0; j < v.size(); ++j) {
-            fprintf(f, j+1==v.size()?"%g": "%g,", v[j]);
-        }
-        fprintf(f, ",%g\n", Z[i]);
-    }
-    fclose(f);
-}
+        // the position after the move
+        copy_board();
+        make_move(move, all_moves);
 
-//no iterative deepining in the server one need to modify gui
-int search_server_position(int depth) {
-    // find best move within a given position
-    int score = negamax(-50000, 50000, depth);
+        int result = (side == white) ? game.result - 1 : 1 - game.result;
+        write_packed(&writer, pack_position(result, packed_no_score, game_ply + 1));
+        outcomes[result + 1]++;
 
-    return pv_table[0][0];
+        take_back();
+    });
+
+    close_packed_writer(&writer);
+
+    long long elapsed = std::max(get_time_ms() - start, 1LL);
+    U64 written = writer.written;
+    std::cout << "info string " << games << " games, " << written << " positions written to " << out_path
+              << (shard_size ? " (" + std::to_string(writer.shard + 1) + " shards)" : "")
+              << " (win " << outcomes[2] << " draw " << outcomes[1] << " loss " << outcomes[0] << ") in " << elapsed << " ms, "
+              << written * 60000 / elapsed << " positions/minute" << std::endl;
 }
 
 /**********************************\
@@ -2899,11 +6734,24 @@ void parse_position(char* command){
     print_board();
 }
 
+// background search thread, so the UCI loop can answer stop/ponderhit/isready while searching
+std::thread search_thread;
+
 // parse UCI "go" command
 void parse_go(char* command){
     // init parameters
     int depth = -1;
 
+    // reset limits left over from the previous "go"
+    movestogo = 30;
+    movetime = -1;
+    _time = -1;
+    inc = 0;
+    nodes_limit = 0;
+    mate_limit = 0;
+    timeset = 0;
+    optimum_time = maximum_time = 0;
+
     // init argument
     char* argument = NULL;
 
@@ -2945,44 +6793,79 @@ void parse_go(char* command){
         // parse search depth
         depth = atoi(argument + 6);
 
-    // if move time is not available
-    if (movetime != -1)
-    {
-        // set time equal to move time
-        _time = movetime;
+    // match UCI "nodes" command
+    if ((argument = strstr(command, "nodes")))
+        // parse node limit
+        nodes_limit = atoll(argument + 6);
 
-        // set moves to go to 1
-        movestogo = 1;
-    }
+    // match UCI "mate" command
+    if ((argument = strstr(command, "mate")))
+        // parse mate in N moves
+        mate_limit = atoi(argument + 5);
+
+    // match UCI "ponder" command: search the expected reply on the opponent's time
+    pondering = strstr(command, "ponder") ? 1 : 0;
 
     // init start time
     starttime = get_time_ms();
 
-    // init search depth
-    depth = depth;
-
     // if time control is available
-    if (_time != -1)
+    if (_time != -1 || movetime != -1)
     {
-        // flag we're playing with time control
-        timeset = 1;
+        // split the clock into optimum and maximum budgets
+        init_time_manager();
+        stoptime = starttime + maximum_time;
 
-        // set up timing
-        _time /= movestogo;
-        _time -= 50;
-        stoptime = starttime + _time + inc;
+        // flag we're playing with time control (the clock starts on "ponderhit" when pondering)
+        timeset = pondering ? 0 : 1;
     }
 
     // if depth is not available
     if (depth == -1)
         // set depth to 64 plies (takes ages to complete...)
-        depth = 64;
+        depth = max_ply;
+
+    // the budget, as an info string so GUIs don't choke on it
+    printf("info string time %d optimum %lld maximum %lld depth %d timeset %d ponder %d\n",
+        _time, optimum_time, maximum_time, depth, (int)timeset, (int)pondering);
+
+    // a book move when playing a game, no search at all
+    if (own_book && !pondering && depth == max_ply && !nodes_limit && !mate_limit && !strstr(command, "infinite")){
+        int book_move = probe_book();
+        if (book_move){
+            std::cout << "bestmove ";
+            print_move(book_move);
+            std::cout << std::endl;
+            return;
+        }
+    }
 
-    printf("time:%d start:%d stop:%d depth:%d timeset:%d\n",
-        _time, starttime, stoptime, depth, timeset);
+    // reset "time is up" flag here, so a "stop" arriving right after "go" isn't lost
+    stopped = 0;
 
-    // search position
-    search_position(depth);
+    // search position in the background, the UCI loop keeps listening for stop/ponderhit
+    search_thread = std::thread(search_position, depth);
+}
+
+// stop the running search (if any) and wait for it to send its bestmove
+void stop_search() {
+    stopped = 1;
+    if (search_thread.joinable())
+        search_thread.join();
+    pondering = 0;
+}
+
+// parse UCI "ponderhit" command: the opponent played the expected move,
+// turn the ponder search into a normal timed one (it keeps its PV, killers and history)
+void ponderhit() {
+    if (!pondering) return;
+
+    // our clock starts now
+    starttime = get_time_ms();
+    stoptime = starttime + maximum_time;
+    if (optimum_time) timeset = 1;
+
+    pondering = 0;
 }
 int parse_server_go(char* command) {
     // init depth
@@ -3034,16 +6917,107 @@ void uci_loop(){
 
         // parse UCI "isready" command
         if (strncmp(input, "isready", 7) == 0){
-            std::cout << "readyok\n";
+            std::cout << "readyok" << std::endl;
             continue;
         }
 
+        // parse UCI "stop" command
+        else if (strncmp(input, "stop", 4) == 0)
+            stop_search();
+
+        // fixed-depth node count over the bench positions (not UCI): "bench [depth]"
+        else if (strncmp(input, "bench", 5) == 0) {
+            stop_search();
+            int depth = atoi(input + 5);
+            bench(depth > 0 ? depth : 7);
+            parse_position(startpos);
+        }
+
+        // fit the classical eval to labeled positions (not UCI): "tune <file> [epochs] [threads]"
+        else if (strncmp(input, "tune", 4) == 0) {
+            stop_search();
+            char path[512] = "";
+            char* arg = input + 4;
+            int length = 0;
+            while (*arg == ' ') arg++;
+            while (*arg && *arg != ' ' && *arg != '\n' && *arg != '\r' && length < 511) path[length++] = *arg++;
+            int epochs = (int)strtol(arg, &arg, 10);
+            int threads = (int)strtol(arg, &arg, 10);
+            if (threads <= 0) threads = std::max((int)std::thread::hardware_concurrency(), 1);
+            tune(path, epochs > 0 ? epochs : 500, threads);
+            parse_position(startpos);
+        }
+
+        // build a Polyglot book from a PGN (not UCI): "makebook <pgn> <book> [plies] [min games] [threads]"
+        else if (strncmp(input, "makebook", 8) == 0) {
+            stop_search();
+            char pgn_path[512] = "", book_path[512] = "";
+            char* arg = input + 8;
+            int length = 0;
+            while (*arg == ' ') arg++;
+            while (*arg && *arg != ' ' && *arg != '\n' && *arg != '\r' && length < 511) pgn_path[length++] = *arg++;
+            length = 0;
+            while (*arg == ' ') arg++;
+            while (*arg && *arg != ' ' && *arg != '\n' && *arg != '\r' && length < 511) book_path[length++] = *arg++;
+            int book_plies = (int)strtol(arg, &arg, 10);
+            int min_games = (int)strtol(arg, &arg, 10);
+            int threads = (int)strtol(arg, &arg, 10);
+            if (threads <= 0) threads = std::max((int)std::thread::hardware_concurrency(), 1);
+            make_book(pgn_path, book_path, book_plies > 0 ? book_plies : 24, min_games > 0 ? min_games : 3, threads);
+            parse_position(startpos);
+        }
+
+        // sample PGN positions into packed training records (not UCI): "gendata <pgn> <out> [sample rate] [min ply] [threads] [shard size]"
+        else if (strncmp(input, "gendata", 7) == 0) {
+            stop_search();
+            char pgn_path[512] = "", out_path[512] = "";
+            char* arg = input + 7;
+            int length = 0;
+            while (*arg == ' ') arg++;
+            while (*arg && *arg != ' ' && *arg != '\n' && *arg != '\r' && length < 511) pgn_path[length++] = *arg++;
+            length = 0;
+            while (*arg == ' ') arg++;
+            while (*arg && *arg != ' ' && *arg != '\n' && *arg != '\r' && length < 511) out_path[length++] = *arg++;
+            double sample_rate = strtod(arg, &arg);
+            char* min_ply_arg = arg;
+            int min_ply = (int)strtol(arg, &arg, 10);
+            char* threads_arg = arg;
+            int threads = (int)strtol(arg, &arg, 10);
+            long long shard_size = strtoll(arg, &arg, 10);
+            if (threads <= 0) threads = std::max((int)std::thread::hardware_concurrency(), 1);
+            generate_data(pgn_path, out_path, sample_rate > 0 ? sample_rate : 0.3, (threads_arg != min_ply_arg) ? min_ply : 10,
+                          (U64)std::max(shard_size, 0LL), threads);
+            parse_position(startpos);
+        }
+
+        // build the 4-piece endgame bitbases into BitbasePath (not UCI): "genbitbases [threads]"
+        else if (strncmp(input, "genbitbases", 11) == 0) {
+            stop_search();
+            int threads = atoi(input + 11);
+            generate_bitbases(threads > 0 ? threads : std::max((int)std::thread::hardware_concurrency(), 1));
+        }
+
+        // print aspiration window statistics (not UCI, debugging aid)
+        else if (strncmp(input, "aspstats", 8) == 0) {
+            stop_search();
+            print_aspiration_stats();
+        }
+
+        // parse UCI "ponderhit" command
+        else if (strncmp(input, "ponderhit", 9) == 0)
+            ponderhit();
+
         // parse UCI "position" command
-        else if (strncmp(input, "position", 8) == 0)
+        else if (strncmp(input, "position", 8) == 0) {
+            // never touch the board under a running search
+            stop_search();
             parse_position(input);
+        }
 
-        // parse UCI "setoption" command (UseNN, NNModelPath)
+        // parse UCI "setoption" command (UseNN, NNModelPath, BitbasePath, OwnBook, BookFile, Move Overhead, Hash, Ponder, MultiPV)
         else if (strncmp(input, "setoption", 9) == 0) {
+            stop_search();
+
             // Expected forms:
             // setoption name UseNN value true|false
             // setoption name NNModelPath value C:\\path\\to\\model.onnx
@@ -3070,26 +7044,78 @@ void uci_loop(){
                         std::cout << "info string NNModelPath set\n";
                     }
                 }
+                else if (strncmp(name_ptr, "BitbasePath", 11) == 0) {
+                    if (value_ptr) {
+                        // drop the line break left by fgets
+                        bitbase_path = value_ptr;
+                        while (!bitbase_path.empty() && (bitbase_path.back() == '\n' || bitbase_path.back() == '\r')) bitbase_path.pop_back();
+                        load_bitbases();
+                    }
+                }
+                else if (strncmp(name_ptr, "OwnBook", 7) == 0) {
+                    own_book = value_ptr && (strncmp(value_ptr, "true", 4) == 0 || strncmp(value_ptr, "True", 4) == 0 || strncmp(value_ptr, "TRUE", 4) == 0);
+                }
+                else if (strncmp(name_ptr, "BookFile", 8) == 0) {
+                    if (value_ptr) {
+                        // drop the line break left by fgets
+                        std::string path = value_ptr;
+                        while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) path.pop_back();
+                        if (path.empty()) unload_book();
+                        else load_book(path.c_str());
+                    }
+                }
+                else if (strncmp(name_ptr, "Move Overhead", 13) == 0) {
+                    if (value_ptr) move_overhead = std::max(0, std::min(atoi(value_ptr), 5000));
+                }
+                else if (set_tunable(name_ptr, value_ptr)) {
+                    // tables derived from the tunables
+                    init_reductions();
+                }
+                else if (strncmp(name_ptr, "Hash", 4) == 0) {
+                    if (value_ptr) {
+                        hash_size_mb = std::max(1, std::min(atoi(value_ptr), 4096));
+                        init_hash_table(hash_size_mb);
+                    }
+                }
+                else if (strncmp(name_ptr, "MultiPV", 7) == 0) {
+                    if (value_ptr) multi_pv = std::max(1, std::min(atoi(value_ptr), max_multi_pv));
+                }
             }
         }
 
         // parse UCI "ucinewgame" command
-        else if (strncmp(input, "ucinewgame", 10) == 0)
+        else if (strncmp(input, "ucinewgame", 10) == 0) {
+            stop_search();
             parse_position(startpos);
+            clear_hash_table();
+            clear_history();
+        }
 
         // parse UCI "go" command
-        else if (strncmp(input, "go", 2) == 0)
+        else if (strncmp(input, "go", 2) == 0) {
+            stop_search();
             parse_go(input);
+        }
 
         // parse UCI "quit" command
-        else if (strncmp(input, "quit", 4) == 0)
+        else if (strncmp(input, "quit", 4) == 0) {
+            stop_search();
             break;
+        }
 
         // parse UCI "uci" command
         else if (strncmp(input, "uci", 3) == 0){
             std::cout << "id name Agata" << "\n";
             std::cout << "option name UseNN type check default false\n";
             std::cout << "option name NNModelPath type string default \n";
+            std::cout << "option name BitbasePath type string default \n";
+            std::cout << "option name OwnBook type check default false\n";
+            std::cout << "option name BookFile type string default \n";
+            std::cout << "option name Move Overhead type spin default 50 min 0 max 5000\n";
+            std::cout << "option name Hash type spin default 64 min 1 max 4096\n";
+            std::cout << "option name Ponder type check default false\n";
+            std::cout << "option name MultiPV type spin default 1 min 1 max " << max_multi_pv << "\n";
+            print_tunables();
             std::cout << "uciok" << std::endl;
         }
     }
@@ -3273,6 +7299,20 @@ void init_all(){
 
     // init random keys for hashing
     init_random_keys();
+
+    // init evaluation tables and endgame knowledge
+    init_evaluation();
+    init_endgames();
+    init_bitbases();
+
+    // init repetition detection tables
+    init_cuckoo();
+
+    // init transposition table
+    init_hash_table(hash_size_mb);
+
+    // init late move reduction table
+    init_reductions();
 }
 
 int main(){
@@ -0,0 +1,61 @@
+#pragma once
+
+// Packed training position: 32 bytes, little endian, written by the
+// engine's gendata command and read back by the PackedReader library.
+//
+//    0  occupancy, one bit per square (a8 = 0, h1 = 63)
+//    8  4-bit pieces (P..k = 0..11) of the occupied squares,
+//       lowest square first, low nibble first
+//   24  castling rights in bits 0-3 (wk wq bk bq), bit 7 set with black to move
+//   25  en passant square, 64 without
+//   26  fifty move counter
+//   27  result for the side to move: 1, 0, -1
+//   28  search score for the side to move, packed_no_score without
+//   30  ply of the game
+//
+// Expanded, a record gives the inputs of the value network (build_features):
+// piece * 64 + square, 768 + castling right, 772 + en passant file, 780 with white to move.
+
+#define packed_no_score -32768
+
+// value network inputs, also the index padding the unused feature slots
+#define packed_feature_count 781
+
+// most inputs set at once: 32 pieces, 4 castling rights, en passant, side to move
+#define packed_max_features 38
+
+typedef struct {
+    unsigned long long occupancy;
+    unsigned char pieces[16];
+    unsigned char flags;
+    unsigned char enpassant;
+    unsigned char fifty;
+    signed char result;
+    short score;
+    unsigned short ply;
+} packed_position;
+
+static_assert(sizeof(packed_position) == 32, "packed_position must stay 32 bytes");
+
+// the inputs set by a record, in packed_max_features slots padded with packed_feature_count; returns how many are set
+static inline int packed_features(const packed_position* packed, short* features){
+    int count = 0, index = 0;
+
+    for (int square = 0; square < 64; square++){
+        if (!((packed->occupancy >> square) & 1ULL)) continue;
+
+        int piece = (packed->pieces[index / 2] >> (4 * (index & 1))) & 15;
+        features[count++] = (short)(piece * 64 + square);
+        index++;
+    }
+
+    for (int right = 0; right < 4; right++)
+        if (packed->flags & (1 << right)) features[count++] = (short)(768 + right);
+
+    if (packed->enpassant < 64) features[count++] = (short)(772 + packed->enpassant % 8);
+    if (!(packed->flags & 0x80)) features[count++] = 780;
+
+    for (int slot = count; slot < packed_max_features; slot++) features[slot] = packed_feature_count;
+
+    return count;
+}
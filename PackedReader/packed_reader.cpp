@@ -0,0 +1,159 @@
+#include "packed_reader.h"
+#include "../Agatav2/packed_position.h"
+
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+    const packed_position* records;
+    unsigned long long count;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+} packed_shard;
+
+struct packed_reader {
+    std::vector<packed_shard> shards;
+    std::vector<unsigned long long> first;      // index of each shard's first record, then the total
+};
+
+// map a shard read-only, 0 if it can't be
+static int map_shard(const char* path, packed_shard* shard){
+    shard->records = nullptr;
+    shard->count = 0;
+
+#ifdef _WIN32
+    shard->file = shard->mapping = nullptr;
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart % sizeof(packed_position)){
+        CloseHandle(file);
+        return 0;
+    }
+
+    // an empty shard has nothing to map
+    if (file_size.QuadPart == 0){
+        CloseHandle(file);
+        return 1;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view){
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+
+    shard->file = file;
+    shard->mapping = mapping;
+    shard->records = (const packed_position*)view;
+    shard->count = (unsigned long long)file_size.QuadPart / sizeof(packed_position);
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) return 0;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size % sizeof(packed_position)){
+        close(file);
+        return 0;
+    }
+
+    if (status.st_size == 0){
+        close(file);
+        return 1;
+    }
+
+    void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (view == MAP_FAILED) return 0;
+
+    shard->records = (const packed_position*)view;
+    shard->count = (unsigned long long)status.st_size / sizeof(packed_position);
+#endif
+
+    return 1;
+}
+
+static void unmap_shard(packed_shard* shard){
+    if (!shard->records) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(shard->records);
+    CloseHandle(shard->mapping);
+    CloseHandle(shard->file);
+#else
+    munmap((void*)shard->records, (size_t)(shard->count * sizeof(packed_position)));
+#endif
+
+    shard->records = nullptr;
+}
+
+packed_reader* packed_reader_open(const char* const* paths, int count){
+    packed_reader* reader = new packed_reader;
+    reader->first.push_back(0);
+
+    for (int index = 0; index < count; index++){
+        packed_shard shard;
+        if (!map_shard(paths[index], &shard)){
+            packed_reader_close(reader);
+            return nullptr;
+        }
+
+        reader->shards.push_back(shard);
+        reader->first.push_back(reader->first.back() + shard.count);
+    }
+
+    return reader;
+}
+
+void packed_reader_close(packed_reader* reader){
+    if (!reader) return;
+
+    for (packed_shard& shard : reader->shards) unmap_shard(&shard);
+    delete reader;
+}
+
+unsigned long long packed_reader_size(const packed_reader* reader){
+    return reader ? reader->first.back() : 0;
+}
+
+int packed_reader_max_features(void){
+    return packed_max_features;
+}
+
+int packed_reader_feature_count(void){
+    return packed_feature_count;
+}
+
+int packed_reader_gather(const packed_reader* reader, const unsigned long long* indexes, int count,
+                         short* features, float* results, short* scores){
+    if (!reader) return 0;
+
+    for (int slot = 0; slot < count; slot++){
+        unsigned long long index = indexes[slot];
+        if (index >= reader->first.back()) return slot;
+
+        // the shard holding the index: the last one starting at or before it
+        size_t shard = std::upper_bound(reader->first.begin(), reader->first.end(), index) - reader->first.begin() - 1;
+        const packed_position* packed = &reader->shards[shard].records[index - reader->first[shard]];
+
+        if (features) packed_features(packed, features + (size_t)slot * packed_max_features);
+        if (results) results[slot] = (float)packed->result;
+        if (scores) scores[slot] = packed->score;
+    }
+
+    return count;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// PackedReader: maps shards of packed_position records (Agatav2/packed_position.h)
+// and expands them to value network inputs on demand, for training from Python
+// (training/packed_data.py) without loading datasets into memory.
+// The reader is read-only once open: several threads may gather from it at once.
+
+#ifdef _WIN32
+#define PACKED_API __declspec(dllexport)
+#else
+#define PACKED_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct packed_reader packed_reader;
+
+// map the shards, in order; NULL if one can't be mapped or isn't a whole number of records
+PACKED_API packed_reader* packed_reader_open(const char* const* paths, int count);
+
+PACKED_API void packed_reader_close(packed_reader* reader);
+
+// records in all the shards, indexed across them in the order they were given
+PACKED_API unsigned long long packed_reader_size(const packed_reader* reader);
+
+// feature slots per record in gather's output, and the index padding the unused ones
+PACKED_API int packed_reader_max_features(void);
+PACKED_API int packed_reader_feature_count(void);
+
+// expand the records at indexes: features gets packed_reader_max_features() input indexes per record,
+// results the result for the side to move, scores the search score (any of the three may be NULL);
+// returns the records expanded, stopping at the first index out of range
+PACKED_API int packed_reader_gather(const packed_reader* reader, const unsigned long long* indexes, int count,
+                                    short* features, float* results, short* scores);
+
+#ifdef __cplusplus
+}
+#endif
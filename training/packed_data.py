@@ -0,0 +1,100 @@
+"""
+Stream packed training positions (the engine's gendata output) through the
+PackedReader library: the shards stay memory-mapped and each batch is expanded
+to feature indexes only when it is drawn, so datasets far larger than RAM train.
+
+Build the library first:
+  Windows: build the PackedReader project of Agatav2.sln (PackedReader.dll)
+  Linux:   g++ -O2 -shared -fPIC PackedReader/packed_reader.cpp -o PackedReader/libpacked_reader.so
+"""
+import ctypes
+import os
+import sys
+from pathlib import Path
+
+import numpy as np
+
+ROOT = Path(__file__).resolve().parent.parent
+LIBRARY_NAMES = ['PackedReader.dll'] if sys.platform == 'win32' else ['libpacked_reader.so', 'libpacked_reader.dylib']
+LIBRARY_DIRS = [ROOT / 'PackedReader', ROOT / 'x64' / 'Release', ROOT / 'x64' / 'Debug', ROOT / 'Release', ROOT / 'Debug']
+
+
+def load_library(path=None):
+    """Find the PackedReader library: path, $PACKED_READER, or the build folders of the repo."""
+    candidates = [path, os.environ.get('PACKED_READER')] + [str(d / n) for d in LIBRARY_DIRS for n in LIBRARY_NAMES]
+    for candidate in candidates:
+        if candidate and os.path.exists(candidate):
+            lib = ctypes.CDLL(candidate)
+            break
+    else:
+        raise FileNotFoundError('PackedReader library not found, build it first (see training/packed_data.py)')
+
+    lib.packed_reader_open.restype = ctypes.c_void_p
+    lib.packed_reader_open.argtypes = [ctypes.POINTER(ctypes.c_char_p), ctypes.c_int]
+    lib.packed_reader_close.argtypes = [ctypes.c_void_p]
+    lib.packed_reader_size.restype = ctypes.c_ulonglong
+    lib.packed_reader_size.argtypes = [ctypes.c_void_p]
+    lib.packed_reader_gather.restype = ctypes.c_int
+    lib.packed_reader_gather.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int,
+                                         ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+    return lib
+
+
+class PackedDataset:
+    """Shards of packed positions, indexed as one dataset."""
+
+    def __init__(self, paths, library=None):
+        # set first: __del__ runs even when opening fails
+        self.reader = None
+        self.lib = load_library(library)
+        self.max_features = self.lib.packed_reader_max_features()
+        self.feature_count = self.lib.packed_reader_feature_count()
+
+        encoded = [str(p).encode() for p in paths]
+        array = (ctypes.c_char_p * len(encoded))(*encoded)
+        self.reader = self.lib.packed_reader_open(array, len(encoded))
+        if not self.reader:
+            raise OSError(f'cannot map {paths} as packed positions')
+        self.size = int(self.lib.packed_reader_size(self.reader))
+
+    def __len__(self):
+        return self.size
+
+    def close(self):
+        if self.reader:
+            self.lib.packed_reader_close(self.reader)
+            self.reader = None
+
+    def __del__(self):
+        self.close()
+
+    def gather(self, indexes):
+        """Feature indexes (n, max_features) padded with feature_count, results (n,), scores (n,)."""
+        indexes = np.ascontiguousarray(indexes, dtype=np.uint64)
+        n = indexes.shape[0]
+        features = np.empty((n, self.max_features), dtype=np.int16)
+        results = np.empty(n, dtype=np.float32)
+        scores = np.empty(n, dtype=np.int16)
+        gathered = self.lib.packed_reader_gather(self.reader, indexes.ctypes.data, n,
+                                                 features.ctypes.data, results.ctypes.data, scores.ctypes.data)
+        if gathered != n:
+            raise IndexError(f'index {int(indexes[gathered])} out of range for {self.size} positions')
+        return features, results, scores
+
+    def batches(self, batch_size, shuffle=True, block=1 << 16, window=16, rng=None):
+        """
+        Yield (features, results, scores) batches over the whole dataset. Shuffled, blocks of
+        records are visited in random order and a window of them is mixed at once, so only the
+        indexes of one window are ever held in memory.
+        """
+        rng = rng or np.random.default_rng()
+        starts = np.arange(0, self.size, block, dtype=np.uint64)
+        if shuffle:
+            rng.shuffle(starts)
+
+        for w in range(0, len(starts), window):
+            indexes = np.concatenate([np.arange(s, min(s + block, self.size), dtype=np.uint64) for s in starts[w:w + window]])
+            if shuffle:
+                rng.shuffle(indexes)
+            for first in range(0, len(indexes), batch_size):
+                yield self.gather(indexes[first:first + batch_size])
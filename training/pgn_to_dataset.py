@@ -17,7 +17,7 @@ import chess.pgn
 def board_to_features(board: chess.Board) -> np.ndarray:
     """
     Build feature vector matching engine format (781 floats):
-    - 12*64 = 768: piece planes P,N,B,R,Q,K,p,n,b,r,q,k (one-hot per square)
+    - 12*64 = 768: piece planes P,N,B,R,Q,K,p,n,b,r,q,k (one-hot per square, a8 = 0)
     - 4: castling rights (wk, wq, bk, bq)
     - 8: en-passant file (one-hot 0..7 if ep square exists)
     - 1: side to move (1 for white, 0 for black)
@@ -34,7 +34,8 @@ def board_to_features(board: chess.Board) -> np.ndarray:
         piece = board.piece_at(sq)
         if piece:
             idx = piece_map[piece.piece_type] + (6 if piece.color == chess.BLACK else 0)
-            x[idx * 64 + sq] = 1.0
+            # the engine numbers squares from a8, python-chess from a1
+            x[idx * 64 + (sq ^ 56)] = 1.0
     
     off = 12 * 64
     # Castling rights (wk, wq, bk, bq)
@@ -70,7 +71,7 @@ def extract_positions_from_game(game, sample_rate=0.3, min_ply=10):
     Extract positions from a single game.
     - sample_rate: probability of sampling each position (to avoid huge datasets)
     - min_ply: skip early opening moves to reduce book bias
-    Returns list of (feature_vector, outcome_from_side_to_move_perspective)
+    Returns list of (feature_vector, outcome_from_side_to_move_perspective, fen)
     """
     result = parse_result(game.headers.get('Result', '*'))
     if result == 0.0 and game.headers.get('Result', '*') == '*':
@@ -96,7 +97,7 @@ def extract_positions_from_game(game, sample_rate=0.3, min_ply=10):
         # result is from white's perspective, so flip if black to move
         z = result if board.turn == chess.WHITE else -result
         
-        positions.append((x, z))
+        positions.append((x, z, board.fen()))
     
     return positions
 
@@ -109,6 +110,8 @@ def main():
     ap.add_argument('--sample-rate', type=float, default=0.3, help='Probability of sampling each position')
     ap.add_argument('--min-ply', type=int, default=10, help='Skip first N plies (opening book)')
     ap.add_argument('--seed', type=int, default=42, help='Random seed')
+    ap.add_argument('--epd', type=str, default=None,
+                    help='Also write the positions as "FEN [result]" lines for the engine\'s tune command')
     args = ap.parse_args()
     
     random.seed(args.seed)
@@ -116,6 +119,7 @@ def main():
     
     X_all = []
     z_all = []
+    epd = open(args.epd, 'w') if args.epd else None
     
     print(f"Parsing {args.pgn}...")
     with open(args.pgn, 'r', encoding='utf-8', errors='ignore') as f:
@@ -126,9 +130,13 @@ def main():
                 break
             
             positions = extract_positions_from_game(game, args.sample_rate, args.min_ply)
-            for x, z in positions:
+            for x, z, fen in positions:
                 X_all.append(x)
                 z_all.append(z)
+                if epd:
+                    # tune wants the result from white's point of view: 1.0 / 0.5 / 0.0
+                    white_z = z if fen.split()[1] == 'w' else -z
+                    epd.write(f"{fen} [{(white_z + 1) / 2:.1f}]\n")
             
             game_count += 1
             if game_count % 1000 == 0:
@@ -137,6 +145,10 @@ def main():
             if args.max_games and game_count >= args.max_games:
                 break
     
+    if epd:
+        epd.close()
+        print(f"Wrote positions to {args.epd}")
+
     if not X_all:
         print("No positions extracted!")
         return
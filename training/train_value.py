@@ -60,7 +60,7 @@ def save_txt_model(model: ValueNet, path: str):
 
 def main():
     ap = argparse.ArgumentParser()
-    ap.add_argument('--data', type=str, required=True, nargs='+', help='NPZ files with keys x (N,INPUT_SIZE) and z (N,) in [-1,1]')
+    ap.add_argument('--data', type=str, required=True, nargs='+', help='NPZ files with keys x (N,INPUT_SIZE) and z (N,) in [-1,1], or .bin shards from the engine\'s gendata (streamed)')
     ap.add_argument('--epochs', type=int, default=10)
     ap.add_argument('--batch', type=int, default=2048)
     ap.add_argument('--hidden', type=int, default=256)
@@ -68,13 +68,32 @@ def main():
     ap.add_argument('--out', type=str, default='value_model.txt')
     args = ap.parse_args()
 
-    ds = Samples(args.data)
-    dl = DataLoader(ds, batch_size=args.batch, shuffle=True, drop_last=False)
-
     model = ValueNet(hidden=args.hidden)
     device = 'cuda' if torch.cuda.is_available() else 'cpu'
     model.to(device)
 
+    # packed shards are streamed, their batches expanded from feature indexes on the device
+    packed = [p for p in args.data if p.endswith('.bin')]
+    if packed and len(packed) != len(args.data):
+        ap.error('--data mixes .bin shards and NPZ files')
+    if packed:
+        from packed_data import PackedDataset
+        ds = PackedDataset(packed)
+        print(f'streaming {len(ds)} positions from {len(packed)} shards')
+
+        def batches():
+            for features, results, _ in ds.batches(args.batch):
+                idx = torch.from_numpy(features.astype(np.int64)).to(device)
+                xb = torch.zeros(idx.shape[0], INPUT_SIZE + 1, device=device)
+                xb.scatter_(1, idx, 1.0)
+                yield xb[:, :INPUT_SIZE], torch.from_numpy(results)
+    else:
+        ds = Samples(args.data)
+        dl = DataLoader(ds, batch_size=args.batch, shuffle=True, drop_last=False)
+
+        def batches():
+            return iter(dl)
+
     opt = optim.Adam(model.parameters(), lr=args.lr)
     loss_fn = nn.MSELoss()
 
@@ -82,7 +101,7 @@ def main():
         model.train()
         total = 0.0
         n = 0
-        for xb, yb in dl:
+        for xb, yb in batches():
             xb = xb.to(device)
             yb = yb.to(device).view(-1, 1)
             opt.zero_grad()